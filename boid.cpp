@@ -4,6 +4,7 @@
 #include <cmath>
 #include <iostream>
 
+#include "fastmath.hpp"
 
 namespace bd {
 // distance between two vectors:
@@ -21,8 +22,8 @@ double distance(const sf::Vector2<double>& vec1,
   double dx = vec2.x - vec1.x;
   double dy = vec2.y - vec1.y;
 
-  if(dx > 1280/2) dx = 1280 -dx;
-  if(dy > 720/2) dy = 720 - dy;
+  if(dx > worldWidth/2) dx = worldWidth -dx;
+  if(dy > worldHeight/2) dy = worldHeight - dy;
 
   return std::sqrt(dx * dx + dy * dy);
 }
@@ -35,6 +36,9 @@ double angle(const sf::Vector2<double>& v) { return std::atan2(v.y, v.x); }
 
 Boid::Boid() : position(0, 0) {}
 Boid::Boid(double pos_x, double pos_y) : position(pos_x, pos_y) {}
+Boid::Boid(const sf::Vector2<double>& pos, const sf::Vector2<double>& vel,
+           const Parameters& p, double max)
+    : position(pos), velocity(vel), par(p), maxspeed(max) {}
 
 sf::Vector2<double> Boid::getPosition() const { return position; }
 void Boid::setPosition(const sf::Vector2<double>& newPos) { position = newPos; }
@@ -42,10 +46,7 @@ void Boid::setPosition(const sf::Vector2<double>& newPos) { position = newPos; }
 sf::Vector2<double> Boid::getVelocity() const { return velocity; }
 void Boid::setVelocity(const sf::Vector2<double>& newVel) { velocity = newVel; }
 
-Parameters Boid::getPar() const { return par; }
-void Boid::setPar(const Parameters& newPar) {
-  par = newPar;
-
+void validate(const Parameters& par) {
   if (par.d < 0.) {
     throw std::runtime_error{
         "Something went wrong. Parameter d must be positive.\n"};
@@ -76,6 +77,12 @@ void Boid::setPar(const Parameters& newPar) {
   }
 }
 
+Parameters Boid::getPar() const { return par; }
+void Boid::setPar(const Parameters& newPar) {
+  par = newPar;
+  validate(par);
+}
+
 void Boid::setPar_d(const double new_d) {
   par.d = new_d;
 
@@ -212,15 +219,18 @@ void Boid::updateVelocity(const std::vector<Boid>& boids) {
 
   velocity += v1 + v2 + v3;
 
-  double mag_v = magnitude(velocity);
-  assert(mag_v >= 0.0);
+  limitSpeed();
+}
 
+void Boid::limitSpeed() {
   // if the absolute value of velocity is greater than the max speed, it gets
   // rescaled within range:
-  if (mag_v > maxspeed) {
-    velocity.x = (velocity.x / mag_v) * maxspeed;
-    velocity.y = (velocity.y / mag_v) * maxspeed;
-  };
+  clampSpeed(velocity.x, velocity.y, maxspeed, MathMode::Exact);
+}
+
+void Boid::steer(const sf::Vector2<double>& dv) {
+  velocity += dv;
+  limitSpeed();
 }
 void Boid::updatePosition(double const delta_t) {
   position += velocity * delta_t;
@@ -230,8 +240,8 @@ void Boid::updatePosition(double const delta_t) {
 // toroidal space: if a point exits from the screen
 // it gets transported back in on the opposite side
 void Boid::borders() {
-  double screenWidth{1280};
-  double screenHeight{720};
+  double screenWidth{worldWidth};
+  double screenHeight{worldHeight};
 
   if (position.x < 0.) {
     position.x = screenWidth;
@@ -251,4 +261,18 @@ void Boid::update(const std::vector<Boid>& boids, double const delta_t) {
   borders();
 }
 
+void Boid::pack(std::vector<double>& out) const {
+  out.insert(out.end(), {position.x, position.y, velocity.x, velocity.y, par.d,
+                         par.ds, par.s, par.a, par.c, maxspeed});
+}
+
+// the parameters were already validated when the boid was packed
+Boid Boid::unpack(const double* in) {
+  Boid b(in[0], in[1]);
+  b.velocity = {in[2], in[3]};
+  b.par = {in[4], in[5], in[6], in[7], in[8]};
+  b.maxspeed = in[9];
+  return b;
+}
+
 }  // namespace bd
\ No newline at end of file
@@ -8,6 +8,10 @@
 
 namespace bd {
 
+// size of the toroidal world the boids live in
+constexpr double worldWidth{1280};
+constexpr double worldHeight{720};
+
 double e_distance(const sf::Vector2<double>& vec1,
                 const sf::Vector2<double>& vec2);
 
@@ -26,15 +30,25 @@ struct Parameters {
   double c{};
 };
 
+// throws if a parameter is out of its range; Boid::setPar checks every boid,
+// bulk constructions check once
+void validate(const Parameters& par);
+
 class Boid {
   sf::Vector2<double> position;
   sf::Vector2<double> velocity;
   Parameters par;
   double maxspeed;
 
+  void limitSpeed();
+
  public:
   Boid();
   Boid(double, double);
+  // the whole state at once; par is not checked, pass it to validate()
+  // first
+  Boid(const sf::Vector2<double>& pos, const sf::Vector2<double>& vel,
+       const Parameters& par, double maxspeed);
 
   sf::Vector2<double> getPosition() const;
   void setPosition(const sf::Vector2<double>& newPos);
@@ -59,11 +73,18 @@ class Boid {
   sf::Vector2<double> cohesion(const std::vector<Boid>& boids);
 
   void updateVelocity(const std::vector<Boid>& boids);
+  // adds a steering term from outside the three rules (obstacles, predators)
+  void steer(const sf::Vector2<double>& dv);
   void updatePosition(double const delta_t);
   void borders();
 
   void update(const std::vector<Boid>& boids, double const delta_t);
 
+  // flat representation of the whole state of a boid (position, velocity,
+  // parameters and maxspeed), used to move boids between processes
+  static constexpr int packedSize{10};
+  void pack(std::vector<double>& out) const;
+  static Boid unpack(const double* in);
 };
 
 }  // namespace bd
@@ -1,8 +1,60 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <random>
+#include <thread>
+
 #include "doctest.h"
 #include "flock.hpp"
 #include "boid.hpp"
+#include "bulk.hpp"
+#include "classed.hpp"
+#include "cluster.hpp"
+#include "command.hpp"
+#include "compact.hpp"
+#include "domain.hpp"
+#include "ensemble.hpp"
+#include "fastmath.hpp"
+#include "fixed.hpp"
+#include "grid.hpp"
+#include "hashgrid.hpp"
+#include "kdtree.hpp"
+#include "obstacle.hpp"
+#include "perception.hpp"
+#include "pipeline.hpp"
+#include "publisher.hpp"
+#include "raster.hpp"
+#include "replay.hpp"
+#include "scheduler.hpp"
+#include "shm.hpp"
+#include "rules.hpp"
+#include "statistics.hpp"
+#include "transport.hpp"
+
+// random flock with a fixed seed, shared by the tests below
+static bd::Flock seededFlock(int N, unsigned seed, const bd::Parameters& par) {
+  std::default_random_engine eng(seed);
+  std::uniform_real_distribution<double> xDist(0, bd::worldWidth);
+  std::uniform_real_distribution<double> yDist(0, bd::worldHeight);
+  std::uniform_real_distribution<double> vDist(-50, 50);
+
+  bd::Flock flock;
+  for (int i = 0; i < N; ++i) {
+    bd::Boid boid(xDist(eng), yDist(eng));
+    boid.setVelocity({vDist(eng), vDist(eng)});
+    boid.setMaxspeed(100);
+    boid.setPar(par);
+    flock.addBoid(boid);
+  }
+  return flock;
+}
 
 TEST_CASE("Testing the vectors functions") {
   SUBCASE("Distance between vectors") {
@@ -391,4 +443,1807 @@ TEST_CASE("Testing the Flock class") {
     CHECK(p2.x == doctest::Approx(2));
     CHECK(p2.y == doctest::Approx(3));
   }
-}
\ No newline at end of file
+}
+TEST_CASE("Testing the domain decomposition") {
+  bd::Parameters par{60, 10, 0.1, 0.1, 0.01};
+
+  SUBCASE("Tiles and owners") {
+    bd::Decomposition dec(2, 2);
+    CHECK(dec.size() == 4);
+    CHECK(dec.owner({10, 10}) == 0);
+    CHECK(dec.owner({1000, 10}) == 1);
+    CHECK(dec.owner({10, 700}) == 2);
+    CHECK(dec.owner({bd::worldWidth, bd::worldHeight}) == 3);
+
+    bd::Tile t = dec.tile(1);
+    CHECK(t.contains({700, 100}));
+    CHECK(t.distance({700, 100}) == doctest::Approx(0));
+    CHECK(t.distance({630, 100}) == doctest::Approx(10));
+    // periodic: the left border of the world touches the right tile
+    CHECK(t.distance({5, 100}) == doctest::Approx(5));
+    CHECK_THROWS(bd::Decomposition(0, 1));
+  }
+
+  SUBCASE("A single tile reproduces Flock::updateFlock") {
+    bd::Flock reference = seededFlock(40, 1, par);
+    auto transports = bd::LocalTransport::create(1);
+    bd::TileFlock tile(bd::Decomposition(1, 1), transports[0], par.d);
+    tile.scatter(reference);
+
+    for (int step = 0; step < 5; ++step) {
+      reference.updateFlock(0.1);
+      tile.step(0.1);
+    }
+    REQUIRE(tile.ownedBoids().size() == 40);
+    for (int i = 0; i < 40; ++i) {
+      CHECK(tile.ownedBoids()[i].getPosition() ==
+            reference.getBoid(i).getPosition());
+      CHECK(tile.ownedBoids()[i].getVelocity() ==
+            reference.getBoid(i).getVelocity());
+    }
+    CHECK(tile.ghostCount() == 0);
+  }
+
+  SUBCASE("Four tiles exchange ghosts, migrate boids and reduce statistics") {
+    bd::Flock initial = seededFlock(80, 2, par);
+    auto transports = bd::LocalTransport::create(4);
+    bd::Decomposition dec(2, 2);
+
+    std::vector<int> sizes(4);
+    std::vector<int> ghosts(4);
+    std::vector<bd::Statistics> speeds(4);
+    std::vector<bd::Statistics> distances(4);
+    std::vector<bd::Flock> gathered(4);
+    std::vector<int> misplaced(4);
+
+    std::vector<std::thread> ranks;
+    for (int r = 0; r < 4; ++r) {
+      ranks.emplace_back([&, r] {
+        bd::TileFlock tile(dec, transports[r], par.d);
+        tile.scatter(initial);
+        for (int step = 0; step < 10; ++step) {
+          tile.step(0.5);
+        }
+        ghosts[r] = tile.ghostCount();
+        for (const bd::Boid& b : tile.ownedBoids()) {
+          if (dec.owner(b.getPosition()) != r) ++misplaced[r];
+        }
+        sizes[r] = tile.size();
+        speeds[r] = tile.average_speed();
+        distances[r] = tile.average_distance();
+        gathered[r] = tile.gather();
+      });
+    }
+    for (auto& t : ranks) t.join();
+
+    for (int r = 0; r < 4; ++r) {
+      CHECK(sizes[r] == 80);
+      CHECK(misplaced[r] == 0);
+      CHECK(ghosts[r] > 0);
+      CHECK(gathered[r].size() == 80);
+      CHECK(speeds[r].mean ==
+            doctest::Approx(gathered[0].average_speed().mean));
+      CHECK(speeds[r].sigma ==
+            doctest::Approx(gathered[0].average_speed().sigma));
+      CHECK(distances[r].mean ==
+            doctest::Approx(gathered[0].average_distance().mean));
+      CHECK(distances[r].sigma ==
+            doctest::Approx(gathered[0].average_distance().sigma));
+    }
+  }
+
+  SUBCASE("Socket transport") {
+    auto transports = bd::SocketTransport::create(3);
+    std::vector<std::vector<bd::Message>> received(3);
+    std::vector<bd::Message> sums(3);
+
+    std::vector<std::thread> ranks;
+    for (int r = 0; r < 3; ++r) {
+      ranks.emplace_back([&, r] {
+        std::vector<bd::Message> out(3);
+        for (int to = 0; to < 3; ++to) {
+          // big enough to fill the socket buffers
+          out[to].assign(100000, r * 10 + to);
+        }
+        received[r] = transports[r].exchange(out);
+        sums[r] = transports[r].allreduce({1.0, static_cast<double>(r)});
+      });
+    }
+    for (auto& t : ranks) t.join();
+
+    for (int r = 0; r < 3; ++r) {
+      for (int from = 0; from < 3; ++from) {
+        if (from == r) continue;
+        REQUIRE(received[r][from].size() == 100000);
+        CHECK(received[r][from].front() == from * 10 + r);
+        CHECK(received[r][from].back() == from * 10 + r);
+      }
+      CHECK(sums[r][0] == doctest::Approx(3));
+      CHECK(sums[r][1] == doctest::Approx(3));
+    }
+  }
+}
+
+TEST_CASE("Testing the control channel") {
+  SUBCASE("Parsing commands") {
+    bd::Command cmd = bd::parseCommand("ds 20");
+    CHECK(cmd.type == bd::CommandType::SetParameter);
+    CHECK(cmd.field == bd::Field::ds);
+    CHECK(cmd.value == doctest::Approx(20));
+
+    cmd = bd::parseCommand("spawn 5 100 200");
+    CHECK(cmd.type == bd::CommandType::Spawn);
+    CHECK(cmd.count == 5);
+    CHECK(cmd.x == doctest::Approx(100));
+    CHECK(cmd.y == doctest::Approx(200));
+
+    CHECK(bd::parseCommand("step").count == 1);
+    CHECK(bd::parseCommand("step 3").count == 3);
+    CHECK(bd::parseCommand("snapshot out.csv").path == "out.csv");
+    CHECK(bd::parseCommand("pause").type == bd::CommandType::Pause);
+
+    CHECK_THROWS(bd::parseCommand(""));
+    CHECK_THROWS(bd::parseCommand("jump"));
+    CHECK_THROWS(bd::parseCommand("s"));
+    CHECK_THROWS(bd::parseCommand("spawn 0 1 1"));
+  }
+
+  SUBCASE("Many producers, one consumer") {
+    bd::CommandQueue queue;
+    const int producers = 4;
+    const int per_producer = 2000;
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+      threads.emplace_back([&queue, p] {
+        for (int i = 0; i < per_producer; ++i) {
+          bd::Command cmd;
+          cmd.type = bd::CommandType::Step;
+          cmd.count = p * per_producer + i;
+          queue.push(cmd);
+        }
+      });
+    }
+
+    std::vector<int> last(producers, -1);
+    int received = 0;
+    bool ordered = true;
+    while (received < producers * per_producer) {
+      bd::Command cmd;
+      if (!queue.pop(cmd)) continue;
+      int p = cmd.count / per_producer;
+      int i = cmd.count % per_producer;
+      // commands of the same producer arrive in order
+      if (i <= last[p]) ordered = false;
+      last[p] = i;
+      ++received;
+    }
+    for (auto& t : threads) t.join();
+
+    bd::Command cmd;
+    CHECK_FALSE(queue.pop(cmd));
+    CHECK(ordered);
+    CHECK(received == producers * per_producer);
+  }
+
+  SUBCASE("Commands are applied between steps") {
+    bd::Parameters par{60, 10, 0.1, 0.1, 0.01};
+    std::vector<bd::Flock> flocks{seededFlock(10, 3, par)};
+    bd::SimulationControl control;
+
+    control.queue().push(bd::parseCommand("s 0.4"));
+    control.queue().push(bd::parseCommand("ds 100"));  // invalid: ds > d
+    control.queue().push(bd::parseCommand("spawn 5 100 100"));
+    control.queue().push(bd::parseCommand("pause"));
+    control.queue().push(bd::parseCommand("step 2"));
+    control.drain(flocks);
+
+    CHECK(flocks[0].size() == 15);
+    CHECK(flocks[0].getBoid(3).getPar().s == doctest::Approx(0.4));
+    CHECK(flocks[0].getBoid(3).getPar().ds == doctest::Approx(10));
+    CHECK(flocks[0].getBoid(12).getPar().s == doctest::Approx(0.4));
+    CHECK(control.isPaused());
+    CHECK(control.advance());
+    CHECK(control.advance());
+    CHECK_FALSE(control.advance());
+
+    control.queue().push(bd::parseCommand("resume"));
+    control.queue().push(bd::parseCommand("snapshot boid.test.snapshot.csv"));
+    control.drain(flocks);
+    CHECK(control.advance());
+
+    std::ifstream in("boid.test.snapshot.csv");
+    std::string line;
+    int lines = 0;
+    while (std::getline(in, line)) ++lines;
+    CHECK(lines == 16);
+    std::remove("boid.test.snapshot.csv");
+  }
+
+  SUBCASE("An invalid value leaves every flock untouched") {
+    // ds 50 is fine for the first flock (d 60), not for the second (d 30)
+    std::vector<bd::Flock> flocks{seededFlock(5, 3, {60, 10, 0.1, 0.1, 0.01}),
+                                  seededFlock(5, 4, {30, 5, 0.1, 0.1, 0.01})};
+    bd::SimulationControl control;
+    control.queue().push(bd::parseCommand("ds 50"));
+    control.drain(flocks);
+    CHECK(flocks[0].getBoid(0).getPar().ds == 10);
+    CHECK(flocks[1].getBoid(0).getPar().ds == 5);
+
+    control.queue().push(bd::parseCommand("ds 20"));
+    control.drain(flocks);
+    CHECK(flocks[0].getBoid(4).getPar().ds == 20);
+    CHECK(flocks[1].getBoid(4).getPar().ds == 20);
+  }
+
+  SUBCASE("Commands read from a pipe") {
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+    bd::SimulationControl control;
+    {
+      bd::ControlEndpoint endpoint(control.queue(), fds[0]);
+      const std::string text = "pause\nbogus\nstep 4\n";
+      CHECK(write(fds[1], text.data(), text.size()) ==
+            static_cast<ssize_t>(text.size()));
+      close(fds[1]);
+      std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    }
+    close(fds[0]);
+
+    std::vector<bd::Flock> flocks;
+    control.drain(flocks);
+    CHECK(control.isPaused());
+    int steps = 0;
+    while (control.advance()) ++steps;
+    CHECK(steps == 4);
+  }
+}
+
+TEST_CASE("Testing the batch math") {
+  std::default_random_engine eng(4);
+  std::uniform_real_distribution<double> dist(-500, 500);
+  const int N = 1000;
+  std::vector<double> x(N);
+  std::vector<double> y(N);
+  for (int i = 0; i < N; ++i) {
+    x[i] = dist(eng);
+    y[i] = dist(eng);
+  }
+  // axes and the null vector
+  x[0] = 0;
+  y[0] = 0;
+  x[1] = -3;
+  y[1] = 0;
+  x[2] = 0;
+  y[2] = -2;
+
+  SUBCASE("Exact mode is bit-exact") {
+    std::vector<double> mag(N);
+    std::vector<double> ang(N);
+    bd::magnitudes(x.data(), y.data(), mag.data(), N, bd::MathMode::Exact);
+    bd::angles(x.data(), y.data(), ang.data(), N, bd::MathMode::Exact);
+    bool same = true;
+    for (int i = 0; i < N; ++i) {
+      same = same && mag[i] == bd::magnitude({x[i], y[i]}) &&
+             ang[i] == bd::angle({x[i], y[i]});
+    }
+    CHECK(same);
+  }
+
+  SUBCASE("Fast mode stays within the documented error") {
+    std::vector<double> mag(N);
+    std::vector<double> ang(N);
+    bd::magnitudes(x.data(), y.data(), mag.data(), N, bd::MathMode::Fast);
+    bd::angles(x.data(), y.data(), ang.data(), N, bd::MathMode::Fast);
+    double max_rel = 0;
+    double max_abs = 0;
+    for (int i = 0; i < N; ++i) {
+      double m = bd::magnitude({x[i], y[i]});
+      if (m > 0) max_rel = std::max(max_rel, std::abs(mag[i] - m) / m);
+      max_abs = std::max(max_abs, std::abs(ang[i] - bd::angle({x[i], y[i]})));
+    }
+    CHECK(mag[0] == 0);
+    CHECK(max_rel < 1e-10);
+    CHECK(max_abs < 2e-8);
+  }
+
+  SUBCASE("Clamping speeds") {
+    const double maxspeed = 200;
+    std::vector<double> vx = x;
+    std::vector<double> vy = y;
+    std::vector<double> fx = x;
+    std::vector<double> fy = y;
+    bd::clampSpeeds(vx.data(), vy.data(), N, maxspeed, bd::MathMode::Exact);
+    bd::clampSpeeds(fx.data(), fy.data(), N, maxspeed, bd::MathMode::Fast);
+
+    // the rescaling Boid::limitSpeed always had, bit for bit
+    bool same = true;
+    double max_rel = 0;
+    for (int i = 0; i < N; ++i) {
+      const double mag = bd::magnitude({x[i], y[i]});
+      const double ex = mag > maxspeed ? (x[i] / mag) * maxspeed : x[i];
+      const double ey = mag > maxspeed ? (y[i] / mag) * maxspeed : y[i];
+      bd::Boid boid;
+      boid.setMaxspeed(maxspeed);
+      boid.steer({x[i], y[i]});
+      same = same && vx[i] == ex && vy[i] == ey &&
+             boid.getVelocity().x == ex && boid.getVelocity().y == ey;
+      const double m = bd::magnitude({vx[i], vy[i]});
+      if (m > 0) {
+        const double dx = fx[i] - vx[i];
+        const double dy = fy[i] - vy[i];
+        max_rel = std::max(max_rel, std::sqrt(dx * dx + dy * dy) / m);
+      }
+    }
+    CHECK(same);
+    CHECK(max_rel < 1e-10);
+    CHECK(bd::magnitude({vx[3], vy[3]}) <= maxspeed * (1 + 1e-15));
+    CHECK(fx[0] == 0);
+    CHECK(fy[0] == 0);
+    CHECK(fx[1] == -3);
+  }
+
+  SUBCASE("Flock statistics with the fast mode") {
+    bd::Flock flock = seededFlock(50, 5, {60, 10, 0.1, 0.1, 0.01});
+    bd::Statistics exact = flock.average_speed();
+    flock.setMathMode(bd::MathMode::Fast);
+    bd::Statistics fast = flock.average_speed();
+    CHECK(fast.mean == doctest::Approx(exact.mean));
+    CHECK(fast.sigma == doctest::Approx(exact.sigma));
+  }
+}
+
+TEST_CASE("Testing the ensemble runner") {
+  std::vector<bd::Parameters> pars{{60, 10, 0.1, 0.1, 0.01},
+                                   {100, 20, 0.3, 0.5, 0.05}};
+  std::vector<unsigned> seeds{1, 2, 3};
+  std::vector<bd::EnsembleRun> runs = bd::parameterGrid(pars, seeds, 12, 500);
+  REQUIRE(runs.size() == 6);
+  CHECK(runs[4].seed == 2);
+  CHECK(runs[4].par.d == doctest::Approx(100));
+
+  SUBCASE("Results match the sequential loop of main.cpp") {
+    bd::EnsembleResult result = bd::runEnsemble(runs, 5.0, 1.0, 3);
+    REQUIRE(result.rows() == 6 * 5);
+
+    bd::Flock flock = bd::randomFlock(12, pars[1], 500, 3);
+    for (int k = 0; k < 5; ++k) {
+      int row = 5 * 5 + k;
+      CHECK(result.run[row] == 5);
+      CHECK(result.step[row] == k);
+      CHECK(result.time[row] == doctest::Approx(k));
+      CHECK(result.distance_mean[row] == flock.average_distance().mean);
+      CHECK(result.distance_sigma[row] == flock.average_distance().sigma);
+      CHECK(result.speed_mean[row] == flock.average_speed().mean);
+      CHECK(result.speed_sigma[row] == flock.average_speed().sigma);
+      flock.updateFlock(1.0);
+    }
+  }
+
+  SUBCASE("Same output with any number of workers") {
+    bd::EnsembleResult one = bd::runEnsemble(runs, 3.0, 1.0, 1);
+    bd::EnsembleResult many = bd::runEnsemble(runs, 3.0, 1.0, 8);
+    CHECK(one.speed_mean == many.speed_mean);
+    CHECK(one.distance_sigma == many.distance_sigma);
+  }
+
+  SUBCASE("Invalid runs throw") {
+    std::vector<bd::EnsembleRun> bad{{pars[0], 1, 1, 500}};
+    CHECK_THROWS(bd::runEnsemble(bad, 1.0, 1.0));
+    CHECK_THROWS(bd::runEnsemble(runs, 1.0, 0.0));
+  }
+}
+
+TEST_CASE("Testing the statistics sink") {
+  SUBCASE("Binary columns round trip over several chunks") {
+    {
+      bd::StatisticsSink sink("boid.test.stats.bin", {"step", "speed"},
+                              bd::SinkFormat::Binary, 16);
+      for (int i = 0; i < 100; ++i) {
+        sink.record({static_cast<double>(i), 0.5 * i});
+      }
+      CHECK_THROWS(sink.record({1.0}));
+    }
+    bd::StatisticsTable table = bd::readStatistics("boid.test.stats.bin");
+    REQUIRE(table.names.size() == 2);
+    CHECK(table.names[1] == "speed");
+    REQUIRE(table.column("step").size() == 100);
+    CHECK(table.column("step")[57] == 57);
+    CHECK(table.column("speed")[99] == doctest::Approx(49.5));
+    CHECK_THROWS(table.column("distance"));
+
+    // little endian on any machine: version 1, then 2 columns
+    std::ifstream raw("boid.test.stats.bin", std::ios::binary);
+    char head[16];
+    raw.read(head, sizeof(head));
+    CHECK(head[8] == 1);
+    CHECK(head[9] == 0);
+    CHECK(head[12] == 2);
+    CHECK(head[15] == 0);
+    std::remove("boid.test.stats.bin");
+  }
+
+  SUBCASE("CSV output") {
+    bd::StatisticsSink sink("boid.test.stats.csv", {"a", "b"},
+                            bd::SinkFormat::Csv, 4);
+    sink.record({1, 2});
+    sink.record({3, 4.5});
+    sink.close();
+    CHECK_THROWS(sink.record({1, 2}));
+
+    std::ifstream in("boid.test.stats.csv");
+    std::string header, row1, row2;
+    std::getline(in, header);
+    std::getline(in, row1);
+    std::getline(in, row2);
+    CHECK(header == "a,b");
+    CHECK(row1 == "1,2");
+    CHECK(row2 == "3,4.5");
+    std::remove("boid.test.stats.csv");
+  }
+
+  SUBCASE("Write failures are reported") {
+    bd::StatisticsSink sink("/dev/full", {"a"}, bd::SinkFormat::Binary, 2);
+    sink.record({1});
+    sink.record({2});
+    sink.record({3});
+    CHECK_THROWS(sink.close());
+    CHECK_THROWS(sink.record({4}));
+  }
+
+  SUBCASE("Invalid sinks") {
+    CHECK_THROWS(bd::StatisticsSink("boid.test.stats.bin", {}));
+    CHECK_THROWS(bd::StatisticsSink("/nonexistent/dir/file.bin", {"a"}));
+    CHECK_THROWS(bd::readStatistics("boid.test.cpp"));
+    std::remove("boid.test.stats.bin");
+  }
+}
+
+TEST_CASE("Testing the spatial grid and the cluster analysis") {
+  SUBCASE("Grid cells and candidates") {
+    bd::SpatialGrid grid(100);
+    CHECK(grid.columns() == 12);
+    CHECK(grid.rows() == 7);
+    std::vector<sf::Vector2<double>> positions{
+        {5, 5}, {1275, 715}, {640, 360}, {bd::worldWidth, 0}};
+    grid.build(positions);
+    CHECK(grid.cellOf(positions[3]) == grid.cellOf(positions[0]));
+
+    std::vector<int> around;
+    grid.candidates({5, 5}, around);
+    // the opposite corner is a periodic neighbour
+    CHECK(around == std::vector<int>{0, 1, 3});
+
+    bd::SpatialGrid coarse(1000);
+    CHECK(coarse.cells() == 1);
+    int cells[9];
+    CHECK(coarse.neighbourCells(0, cells) == 1);
+    CHECK_THROWS(bd::SpatialGrid(0));
+
+    sf::Vector2<double> delta = bd::minimumImage({1275, 5}, {5, 715});
+    CHECK(delta.x == doctest::Approx(10));
+    CHECK(delta.y == doctest::Approx(-10));
+    sf::Vector2<double> p = bd::wrapPosition({-10, 730});
+    CHECK(p.x == doctest::Approx(1270));
+    CHECK(p.y == doctest::Approx(10));
+  }
+
+  SUBCASE("Two groups, one of them across the border") {
+    std::vector<bd::Boid> boids;
+    for (double x : {1270., 5., 15.}) {
+      bd::Boid b(x, 100);
+      b.setVelocity({2, 0});
+      boids.push_back(b);
+    }
+    for (double y : {400., 410.}) {
+      bd::Boid b(600, y);
+      b.setVelocity({0, -1});
+      boids.push_back(b);
+    }
+    bd::ClusterAnalysis analysis = bd::findClusters(boids, 20);
+    REQUIRE(analysis.count() == 2);
+    CHECK(analysis.label == std::vector<int>{0, 0, 0, 1, 1});
+    CHECK(analysis.clusters[0].size == 3);
+    CHECK(analysis.clusters[0].centroid.x == doctest::Approx(3.333).epsilon(0.001));
+    CHECK(analysis.clusters[0].velocity.x == doctest::Approx(2));
+    CHECK(analysis.clusters[1].centroid.y == doctest::Approx(405));
+    CHECK(analysis.size_histogram == std::vector<int>{0, 2});
+  }
+
+  SUBCASE("Same components as a brute force search, with any thread count") {
+    bd::Flock flock = seededFlock(3000, 6, {60, 10, 0.1, 0.1, 0.01});
+    const auto& boids = flock.flock();
+    const double d = 15;
+
+    // brute force labelling by flood fill
+    const int N = boids.size();
+    std::vector<int> label(N, -1);
+    int count = 0;
+    for (int s = 0; s < N; ++s) {
+      if (label[s] >= 0) continue;
+      std::vector<int> stack{s};
+      label[s] = count;
+      while (!stack.empty()) {
+        int i = stack.back();
+        stack.pop_back();
+        for (int j = 0; j < N; ++j) {
+          if (label[j] >= 0) continue;
+          auto delta = bd::minimumImage(boids[i].getPosition(),
+                                        boids[j].getPosition());
+          if (delta.x * delta.x + delta.y * delta.y < d * d) {
+            label[j] = count;
+            stack.push_back(j);
+          }
+        }
+      }
+      ++count;
+    }
+
+    bd::ClusterAnalysis one = bd::findClusters(boids, d, 1);
+    bd::ClusterAnalysis many = bd::findClusters(boids, d, 4);
+    CHECK(one.count() == count);
+    CHECK(one.label == label);
+    CHECK(many.label == label);
+  }
+}
+
+TEST_CASE("Testing the order parameters") {
+  SUBCASE("Aligned flock and mill") {
+    bd::Flock aligned;
+    bd::Flock mill;
+    for (int i = 0; i < 36; ++i) {
+      double phi = i * 2 * M_PI / 36;
+      bd::Boid a(100 + 3 * i, 200);
+      a.setVelocity({3, 4});
+      aligned.addBoid(a);
+      // boids on a circle moving along it
+      bd::Boid m(640 + 50 * std::cos(phi), 360 + 50 * std::sin(phi));
+      m.setVelocity({-std::sin(phi), std::cos(phi)});
+      mill.addBoid(m);
+    }
+    bd::OrderParameters pa = aligned.orderParameters();
+    bd::OrderParameters pm = mill.orderParameters();
+    CHECK(pa.polarization == doctest::Approx(1));
+    CHECK(pa.rotation == doctest::Approx(0));
+    CHECK(pa.speed.mean == doctest::Approx(5));
+    CHECK(pm.polarization == doctest::Approx(0).epsilon(1e-9));
+    CHECK(pm.rotation == doctest::Approx(1));
+  }
+
+  SUBCASE("A mill across the border of the world") {
+    bd::Flock mill;
+    for (int i = 0; i < 36; ++i) {
+      double phi = i * 2 * M_PI / 36;
+      bd::Boid m(0, 0);
+      m.setPosition(bd::wrapPosition({50 * std::cos(phi), 50 * std::sin(phi)}));
+      m.setVelocity({-std::sin(phi), std::cos(phi)});
+      mill.addBoid(m);
+    }
+    CHECK(mill.orderParameters().rotation == doctest::Approx(1));
+  }
+
+  SUBCASE("Accumulated by updateFlock") {
+    bd::Flock tracked = seededFlock(60, 7, {60, 10, 0.1, 0.1, 0.01});
+    bd::Flock plain = tracked;
+    tracked.setOrderTracking(true);
+    for (int step = 0; step < 3; ++step) {
+      tracked.updateFlock(0.5);
+      plain.updateFlock(0.5);
+    }
+    bd::OrderParameters during = tracked.orderParameters();
+    bd::OrderParameters after = plain.orderParameters();
+    CHECK(during.polarization == doctest::Approx(after.polarization));
+    CHECK(during.rotation == doctest::Approx(after.rotation));
+    CHECK(during.speed.mean == doctest::Approx(plain.average_speed().mean));
+    CHECK(during.speed.sigma == doctest::Approx(plain.average_speed().sigma));
+    CHECK(tracked.getBoid(5).getPosition() == plain.getBoid(5).getPosition());
+  }
+
+  SUBCASE("Partial sums merge") {
+    bd::Flock flock = seededFlock(20, 8, {60, 10, 0.1, 0.1, 0.01});
+    bd::OrderSums all;
+    bd::OrderSums first;
+    bd::OrderSums second;
+    for (int i = 0; i < 20; ++i) {
+      all.add(flock.getBoid(i));
+      (i < 7 ? first : second).add(flock.getBoid(i));
+    }
+    first += second;
+    CHECK(first.result().polarization ==
+          doctest::Approx(all.result().polarization));
+    CHECK(first.result().rotation == doctest::Approx(all.result().rotation));
+  }
+}
+
+TEST_CASE("Testing obstacles and predators") {
+  std::vector<bd::Obstacle> obstacles{{{640, 360}, 50}, {{10, 10}, 20}};
+  auto field = std::make_shared<bd::DistanceField>(obstacles, 5);
+
+  SUBCASE("Signed distance field") {
+    CHECK(field->sample({640, 360}) == doctest::Approx(-50).epsilon(0.02));
+    CHECK(field->sample({740, 360}) == doctest::Approx(50).epsilon(0.02));
+    CHECK(field->sample({640, 300}) == doctest::Approx(10).epsilon(0.05));
+    // the obstacle at the corner is seen across the border
+    CHECK(field->sample({1275, 10}) == doctest::Approx(-5).epsilon(0.2));
+
+    sf::Vector2<double> g = field->gradient({700, 360});
+    CHECK(g.x > 0.9);
+    CHECK(std::abs(g.y) < 0.1);
+    CHECK_THROWS(bd::DistanceField(obstacles, 0));
+  }
+
+  SUBCASE("Boids are pushed away from obstacles") {
+    auto env = std::make_shared<bd::Environment>();
+    env->setObstacles(field, 30, 2);
+
+    bd::Boid boid(580, 360);  // 10 from the obstacle, heading at it
+    boid.setVelocity({10, 0});
+    boid.setMaxspeed(100);
+    boid.setPar({60, 10, 0.1, 0.1, 0.01});
+    sf::Vector2<double> dv = env->steering(boid);
+    CHECK(dv.x < 0);
+
+    bd::Boid far(300, 100);
+    CHECK(env->steering(far).x == 0);
+    CHECK(env->steering(far).y == 0);
+
+    bd::Flock flock;
+    flock.addBoid(boid);
+    flock.setEnvironment(env);
+    for (int step = 0; step < 20; ++step) {
+      flock.updateFlock(0.5);
+    }
+    // it never gets inside
+    CHECK(field->sample(flock.getBoid(0).getPosition()) > 0);
+  }
+
+  SUBCASE("Boids flee from predators") {
+    auto env = std::make_shared<bd::Environment>(50);
+    env->setFlee(10);
+    env->setPredatorSpeed(20);
+    bd::Boid predator(200, 200);
+    env->addPredator(predator);
+
+    bd::Boid close(220, 200);
+    bd::Boid away(400, 200);
+    CHECK(env->steering(close).x > 0);
+    CHECK(env->steering(away).x == 0);
+
+    env->update({close}, 1.0);
+    CHECK(env->predators()[0].getPosition().x == doctest::Approx(220));
+  }
+}
+
+TEST_CASE("Testing the rule pipeline") {
+  bd::Parameters par{60, 10, 0.1, 0.1, 0.01};
+
+  SUBCASE("The Reynolds pipeline is the reference update") {
+    bd::Flock reference = seededFlock(50, 9, par);
+    bd::Flock fused = reference;
+    for (int step = 0; step < 5; ++step) {
+      reference.updateFlock(0.5);
+      bd::updateFlock(fused, bd::Reynolds{}, 0.5);
+    }
+    bool same = true;
+    for (int i = 0; i < 50; ++i) {
+      same = same &&
+             fused.getBoid(i).getPosition() ==
+                 reference.getBoid(i).getPosition() &&
+             fused.getBoid(i).getVelocity() ==
+                 reference.getBoid(i).getVelocity();
+    }
+    CHECK(same);
+    CHECK(bd::Reynolds{}.radius(par) == doctest::Approx(60));
+  }
+
+  SUBCASE("Single rules") {
+    bd::Flock flock = seededFlock(20, 10, par);
+    const auto& boids = flock.flock();
+    bd::Boid b = boids[3];
+    sf::Vector2<double> dv =
+        bd::RulePipeline<bd::Cohesion>{}.velocityChange(b, boids);
+    CHECK(dv == b.cohesion(boids));
+    dv = bd::RulePipeline<bd::Separation>{}.velocityChange(b, boids);
+    CHECK(dv == b.separation(boids));
+  }
+
+  SUBCASE("Wind and goal seeking") {
+    bd::Boid b(100, 100);
+    b.setVelocity({0, 0});
+    b.setMaxspeed(50);
+    b.setPar(par);
+    std::vector<bd::Boid> alone{b};
+
+    bd::RulePipeline<bd::Wind, bd::GoalSeeking> extra(
+        bd::Wind{{1, 0}}, bd::GoalSeeking{{1270, 100}, 0.5});
+    sf::Vector2<double> dv = extra.velocityChange(b, alone);
+    // the goal is closer across the left border
+    CHECK(dv.x == doctest::Approx(1 - 0.5 * 110));
+    CHECK(dv.y == doctest::Approx(0));
+    CHECK(extra.radius(par) == doctest::Approx(0));
+
+    bd::RulePipeline<bd::Separation, bd::Alignment, bd::Cohesion, bd::Wind>
+        windy({}, {}, {}, bd::Wind{{0, 2}});
+    b.setVelocity({1, 1});
+    windy.update(b, alone, 1.0);
+    CHECK(b.getVelocity().y == doctest::Approx(3));
+    CHECK(b.getPosition().y == doctest::Approx(103));
+  }
+}
+
+TEST_CASE("Testing the field of view") {
+  bd::Parameters par{60, 10, 0.1, 0.1, 0.01};
+
+  SUBCASE("Cone test") {
+    bd::Perception half = bd::Perception::cone(180);
+    CHECK(half.sees({1, 0}, {5, 3}));
+    CHECK_FALSE(half.sees({1, 0}, {-5, 3}));
+    bd::Perception wide = bd::Perception::cone(270);
+    CHECK(wide.sees({1, 0}, {-1, 3}));
+    CHECK_FALSE(wide.sees({1, 0}, {-3, 1}));
+    bd::Perception narrow = bd::Perception::cone(60);
+    CHECK(narrow.sees({2, 0}, {10, 5}));
+    CHECK_FALSE(narrow.sees({2, 0}, {10, 7}));
+    // a still boid sees everything
+    CHECK(narrow.sees({0, 0}, {-1, 0}));
+    CHECK_FALSE(bd::Perception{}.isActive());
+    CHECK_THROWS(bd::Perception::cone(0));
+    CHECK_THROWS(bd::Perception::cone(90, -1));
+  }
+
+  SUBCASE("Visible neighbours") {
+    std::vector<bd::Boid> boids;
+    for (double x : {100., 110., 90., 120., 200., 1275.}) {
+      bd::Boid b(x, 100);
+      b.setVelocity({1, 0});
+      boids.push_back(b);
+    }
+    std::vector<int> all{0, 1, 2, 3, 4, 5};
+    std::vector<int> out{7, 7, 7};
+
+    // behind and far boids are culled
+    bd::visibleNeighbours(0, boids, all, 60, bd::Perception::cone(180), out);
+    CHECK(out == std::vector<int>{0, 1, 3});
+
+    // only the nearest visible one
+    bd::visibleNeighbours(0, boids, all, 60, bd::Perception::cone(180, 1), out);
+    CHECK(out == std::vector<int>{0, 1});
+
+    // across the border, the boids at the left of the world are in front of
+    // the one at 1275
+    bd::visibleNeighbours(5, boids, all, 200, bd::Perception::cone(180), out);
+    CHECK(out == std::vector<int>{0, 1, 2, 3, 5});
+  }
+
+  SUBCASE("Full view with no effective cap reproduces updateFlock") {
+    bd::Flock reference = seededFlock(60, 11, par);
+    bd::Flock perceiving = reference;
+    perceiving.setPerception(bd::Perception::cone(360, 1000));
+    for (int step = 0; step < 4; ++step) {
+      reference.updateFlock(0.5);
+      perceiving.updateFlock(0.5);
+    }
+    bool same = true;
+    for (int i = 0; i < 60; ++i) {
+      same = same && perceiving.getBoid(i).getPosition() ==
+                         reference.getBoid(i).getPosition();
+    }
+    CHECK(same);
+  }
+
+  SUBCASE("A boid ignores the flock behind it") {
+    bd::Flock flock;
+    bd::Boid leader(200, 200);
+    leader.setVelocity({10, 0});
+    flock.addBoid(leader);
+    for (int i = 1; i <= 5; ++i) {
+      bd::Boid follower(200 - 8 * i, 200 + i);
+      follower.setVelocity({0, 10});
+      flock.addBoid(follower);
+    }
+    flock.setParameters(par);
+    for (auto& b : flock.mutate()) b.setMaxspeed(100);
+
+    bd::Flock blind = flock;
+    blind.setPerception(bd::Perception::cone(180));
+    flock.updateFlock(1.0);
+    blind.updateFlock(1.0);
+    CHECK(flock.getBoid(0).getVelocity().y > 0);
+    CHECK(blind.getBoid(0).getVelocity().y == doctest::Approx(0));
+    CHECK(blind.getBoid(0).getVelocity().x == doctest::Approx(10));
+  }
+}
+
+TEST_CASE("Testing the topological interaction") {
+  bd::Parameters par{60, 10, 0.1, 0.1, 0.01};
+
+  SUBCASE("KD-tree neighbours match a brute force search") {
+    bd::Flock flock = seededFlock(5000, 12, par);
+    std::vector<sf::Vector2<double>> points;
+    for (const auto& b : flock.flock()) points.push_back(b.getPosition());
+
+    bd::KdTree serial;
+    bd::KdTree parallel;
+    serial.build(points, 1);
+    parallel.build(points, 4);
+    CHECK(parallel.size() == 5000);
+
+    bool same = true;
+    std::vector<int> a, b;
+    for (int q = 0; q < 5000; q += 97) {
+      std::vector<std::pair<double, int>> all;
+      for (int j = 0; j < 5000; ++j) {
+        if (j == q) continue;
+        auto r = bd::minimumImage(points[q], points[j]);
+        all.emplace_back(r.x * r.x + r.y * r.y, j);
+      }
+      std::sort(all.begin(), all.end());
+      serial.nearest(points[q], 7, a, q);
+      parallel.nearest(points[q], 7, b, q);
+      for (int k = 0; k < 7; ++k) {
+        same = same && a[k] == all[k].second && b[k] == all[k].second;
+      }
+    }
+    CHECK(same);
+  }
+
+  SUBCASE("Neighbours across the border") {
+    bd::KdTree tree;
+    std::vector<sf::Vector2<double>> points{
+        {2, 2}, {1278, 718}, {640, 360}, {30, 30}};
+    tree.build(points);
+    std::vector<int> out;
+    tree.nearest({1, 1}, 2, out);
+    CHECK(out == std::vector<int>{0, 1});
+    tree.nearest({2, 2}, 1, out, 0);
+    CHECK(out == std::vector<int>{1});
+  }
+
+  SUBCASE("Alignment with the k nearest, whatever their distance") {
+    bd::Flock flock;
+    bd::Boid a(100, 100);
+    a.setVelocity({10, 0});
+    bd::Boid b(400, 100);  // farther than d
+    b.setVelocity({0, 10});
+    bd::Boid c(900, 600);
+    c.setVelocity({0, -10});
+    flock.addBoid(a);
+    flock.addBoid(b);
+    flock.addBoid(c);
+    flock.setParameters(par);
+    for (auto& boid : flock.mutate()) boid.setMaxspeed(100);
+
+    bd::Flock metric = flock;
+    flock.setTopological(1);
+    flock.updateFlock(1.0);
+    metric.updateFlock(1.0);
+
+    CHECK(metric.getBoid(0).getVelocity().y == doctest::Approx(0));
+    // a aligns with b, its nearest neighbour, and moves towards it
+    CHECK(flock.getBoid(0).getVelocity().y == doctest::Approx(1.0));
+    CHECK(flock.getBoid(0).getVelocity().x == doctest::Approx(10 - 1 + 3));
+    CHECK_THROWS(flock.setTopological(-1));
+  }
+
+  SUBCASE("Separation sees every boid within ds, not only the k nearest") {
+    // five still boids within ds = 10 on the right of the first one, and
+    // only separation acting
+    bd::Flock flock;
+    for (double x : {100., 102., 103., 104., 105., 106.}) {
+      bd::Boid b(x, 100);
+      b.setPar({60, 10, 0.1, 0., 0.});
+      b.setMaxspeed(100);
+      flock.addBoid(b);
+    }
+    flock.setTopological(1);
+    flock.updateFlock(0.01);
+    // -s times the sum of the displacements 2 + 3 + 4 + 5 + 6
+    CHECK(flock.getBoid(0).getVelocity().x == doctest::Approx(-2.0));
+    CHECK(flock.getBoid(0).getVelocity().y == doctest::Approx(0.0));
+  }
+}
+
+TEST_CASE("Testing the replay checker") {
+  bd::Parameters par{60, 10, 0.1, 0.1, 0.01};
+  const bd::Flock initial = seededFlock(300, 21, par);
+  const bd::Engine reference = bd::referenceEngine();
+
+  SUBCASE("Engines with the reference dynamics") {
+    bd::Engine flock_update = [](bd::Flock& f, double dt) {
+      f.updateFlock(dt);
+    };
+    bd::Engine pipeline = [](bd::Flock& f, double dt) {
+      bd::updateFlock(f, bd::Reynolds{}, dt);
+    };
+    bd::Engine grid = [](bd::Flock& f, double dt) {
+      // all around, capped above the flock size: only the grid lookup
+      f.setPerception(bd::Perception{-1., 1000});
+      f.updateFlock(dt);
+    };
+
+    for (const auto& engine : {flock_update, pipeline, grid}) {
+      bd::ReplayReport report =
+          bd::compareEngines(initial, reference, engine, 50, 0.05, 0.);
+      CHECK(report.steps.size() == 50);
+      CHECK(report.passed());
+      CHECK(report.max().position == 0.);
+      CHECK(report.max().velocity == 0.);
+    }
+  }
+
+  SUBCASE("An engine with different physics") {
+    bd::Engine topological = [](bd::Flock& f, double dt) {
+      f.setTopological(6);
+      f.updateFlock(dt);
+    };
+    bd::ReplayReport report =
+        bd::compareEngines(initial, reference, topological, 50, 0.05, 1e-6);
+    CHECK_FALSE(report.passed());
+    CHECK(report.first_failure >= 0);
+    CHECK(report.steps[report.first_failure].velocity > 1e-6);
+  }
+
+  SUBCASE("Golden trajectories") {
+    bd::recordTrajectory("boid.test.golden.bin", initial, reference, 40, 0.05);
+    {
+      // version, boids and steps are little endian on any machine
+      std::ifstream raw("boid.test.golden.bin", std::ios::binary);
+      unsigned char head[20]{};
+      raw.read(reinterpret_cast<char*>(head), sizeof(head));
+      CHECK(head[8] == 1);
+      CHECK(head[11] == 0);
+      CHECK(head[12] == initial.size() % 256);
+      CHECK(head[13] == initial.size() / 256 % 256);
+      CHECK(head[16] == 40);
+      CHECK(head[19] == 0);
+    }
+
+    bd::ReplayReport same =
+        bd::compareTrajectory("boid.test.golden.bin", reference, 0.);
+    CHECK(same.steps.size() == 40);
+    CHECK(same.passed());
+
+    // a small change of the physics is caught within the tolerance
+    bd::Engine windy = [](bd::Flock& f, double dt) {
+      bd::updateFlock(
+          f, bd::RulePipeline<bd::Separation, bd::Alignment, bd::Cohesion,
+                              bd::Wind>{{}, {}, {}, bd::Wind{{1e-3, 0}}},
+          dt);
+    };
+    bd::ReplayReport changed =
+        bd::compareTrajectory("boid.test.golden.bin", windy, 1e-9);
+    CHECK_FALSE(changed.passed());
+    CHECK(changed.first_failure == 0);
+
+    std::ofstream("boid.test.golden.bin", std::ios::binary) << "BOIDTRAJ";
+    CHECK_THROWS(bd::compareTrajectory("boid.test.golden.bin", reference, 0.));
+    std::remove("boid.test.golden.bin");
+    CHECK_THROWS(bd::compareTrajectory("boid.test.golden.bin", reference, 0.));
+  }
+}
+
+TEST_CASE("Testing the offscreen renderer") {
+  SUBCASE("A boid is a triangle pointing along its velocity") {
+    bd::Flock flock;
+    bd::Boid boid(640, 360);
+    boid.setVelocity({10, 0});
+    flock.addBoid(boid);
+    flock.setColor({255, 128, 0});
+
+    bd::Rasterizer frame(1280, 720, 2);
+    frame.clear({10, 20, 30});
+    frame.draw(flock);
+    auto at = [&frame](int x, int y) {
+      return frame.pixels()[3 * (y * 1280 + x)];
+    };
+    // base at x = 644, tip at x = 660
+    CHECK(at(650, 360) == 255);
+    CHECK(at(645, 360) == 255);
+    CHECK(frame.pixels()[3 * (360 * 1280 + 650) + 1] == 128);
+    CHECK(at(635, 360) == 10);
+    CHECK(at(662, 360) == 10);
+    CHECK(at(650, 370) == 10);
+  }
+
+  SUBCASE("The frame does not depend on the threads") {
+    bd::Parameters par{60, 10, 0.1, 0.1, 0.01};
+    bd::Flock flock = seededFlock(3000, 5, par);
+    flock.setColor({200, 100, 50});
+
+    bd::Rasterizer one(1920, 1080, 1, 64);
+    bd::Rasterizer many(1920, 1080, 4, 32);
+    one.clear();
+    many.clear();
+    one.draw(flock);
+    many.draw(flock);
+    CHECK(one.pixels() == many.pixels());
+    CHECK(std::count(one.pixels().begin(), one.pixels().end(), 200) > 3000);
+  }
+
+  SUBCASE("Frame files") {
+    bd::Rasterizer frame(33, 17, 1);
+    frame.clear({1, 2, 3});
+    CHECK(bd::frameFormat("a.ppm") == bd::FrameFormat::Ppm);
+    CHECK(bd::frameFormat("a.png") == bd::FrameFormat::Png);
+    CHECK(bd::frameFormat("video.fifo") == bd::FrameFormat::Raw);
+
+    {
+      bd::FrameWriter ppm("boid.test.frame.ppm", bd::FrameFormat::Ppm);
+      bd::FrameWriter png("boid.test.frame.png", bd::FrameFormat::Png);
+      bd::FrameWriter raw("boid.test.frames.rgb", bd::FrameFormat::Raw);
+      for (int i = 0; i < 2; ++i) {
+        ppm.write(frame);
+        png.write(frame);
+        raw.write(frame);
+      }
+      CHECK(raw.frames() == 2);
+    }
+
+    std::ifstream ppm("boid.test.frame00001.ppm", std::ios::binary);
+    std::string magic;
+    int w{}, h{}, max{};
+    ppm >> magic >> w >> h >> max;
+    CHECK(magic == "P6");
+    CHECK(w == 33);
+    CHECK(h == 17);
+    CHECK(max == 255);
+
+    std::ifstream png("boid.test.frame00000.png", std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(png)),
+                      std::istreambuf_iterator<char>());
+    CHECK(bytes.substr(1, 3) == "PNG");
+    // signature, IHDR, IDAT with one stored block, IEND
+    CHECK(bytes.size() == 8 + 25 + 12 + (2 + 5 + (3 * 33 + 1) * 17 + 4) + 12);
+    CHECK(bytes.substr(bytes.size() - 8, 4) == "IEND");
+
+    std::ifstream raw("boid.test.frames.rgb", std::ios::binary | std::ios::ate);
+    CHECK(raw.tellg() == 2 * 3 * 33 * 17);
+
+    for (const char* name :
+         {"boid.test.frame00000.ppm", "boid.test.frame00001.ppm",
+          "boid.test.frame00000.png", "boid.test.frame00001.png",
+          "boid.test.frames.rgb"}) {
+      std::remove(name);
+    }
+  }
+
+  SUBCASE("Write failures are reported") {
+    bd::Rasterizer frame(33, 17, 1);
+    CHECK_THROWS(bd::writePpm("/dev/full", frame));
+    CHECK_THROWS(bd::writePng("/dev/full", frame));
+  }
+}
+
+TEST_CASE("Testing the boid classes") {
+  bd::Parameters flockers{60, 10, 0.1, 0.1, 0.01};
+  bd::Parameters leaders{80, 15, 0.2, 0.01, 0.001};
+  bd::Parameters stragglers{30, 5, 0.05, 0.05, 0.05};
+
+  std::default_random_engine eng(3);
+  std::uniform_real_distribution<double> xDist(0, bd::worldWidth);
+  std::uniform_real_distribution<double> yDist(0, bd::worldHeight);
+  std::uniform_real_distribution<double> vDist(-50, 50);
+  bd::Flock flock;
+  for (int i = 0; i < 400; ++i) {
+    bd::Boid b(xDist(eng), yDist(eng));
+    b.setVelocity({vDist(eng), vDist(eng)});
+    if (i % 10 == 0) {
+      b.setPar(leaders);
+      b.setMaxspeed(120);
+    } else if (i % 10 == 1) {
+      b.setPar(stragglers);
+      b.setMaxspeed(40);
+    } else {
+      b.setPar(flockers);
+      b.setMaxspeed(100);
+    }
+    flock.addBoid(b);
+  }
+
+  SUBCASE("Conversion from and to a flock") {
+    bd::ClassedFlock classed = bd::ClassedFlock::fromFlock(flock);
+    CHECK(classed.size() == 400);
+    CHECK(classed.classes() == 3);
+    CHECK(classed.classOf(0) == 0);
+    CHECK(classed.classOf(11) == 1);
+    CHECK(classed.classOf(12) == 2);
+    CHECK(classed.boidClass(1).maxspeed == 40);
+    CHECK(classed.getBoid(10).getPar().d == 80);
+    CHECK(bd::divergence(classed.toFlock(), flock).position == 0.);
+  }
+
+  SUBCASE("Same trajectories as the flock") {
+    bd::ClassedFlock classed = bd::ClassedFlock::fromFlock(flock);
+    for (int step = 0; step < 30; ++step) {
+      flock.updateFlock(0.05);
+      classed.updateFlock(0.05);
+    }
+    bd::Divergence div = bd::divergence(classed.toFlock(), flock);
+    CHECK(div.position == 0.);
+    CHECK(div.velocity == 0.);
+  }
+
+  SUBCASE("Changing a class changes all its boids") {
+    bd::ClassedFlock classed = bd::ClassedFlock::fromFlock(flock);
+    classed.setClass(1, {stragglers, 10});
+    classed.updateFlock(0.05);
+    CHECK(bd::magnitude(classed.velocity(1)) <= 10 + 1e-9);
+    CHECK(bd::magnitude(classed.velocity(11)) <= 10 + 1e-9);
+  }
+
+  SUBCASE("Invalid classes") {
+    bd::ClassedFlock classed;
+    CHECK_THROWS(classed.addClass({{10, 20, 0.1, 0.1, 0.1}, 100}));
+    CHECK_THROWS(classed.addBoid({0, 0}, {0, 0}, 0));
+    for (int k = 0; k < bd::ClassedFlock::maxClasses; ++k) {
+      classed.addClass({flockers, 100. + k});
+    }
+    CHECK_THROWS(classed.addClass({flockers, 1}));
+    classed.addBoid({0, 0}, {0, 0}, 255);
+    CHECK(classed.getBoid(0).getMaxspeed() == 355);
+    CHECK_THROWS(classed.setClassOf(0, 256));
+  }
+}
+
+TEST_CASE("Testing the adaptive scheduler") {
+  SUBCASE("Every task runs once") {
+    bd::AdaptiveScheduler scheduler(4);
+    std::vector<double> weights(1000);
+    for (int t = 0; t < 1000; ++t) weights[t] = t % 7 == 0 ? 50. : 1.;
+    std::vector<int> runs(1000);
+    for (int k = 0; k < 20; ++k) {
+      scheduler.run(weights, [&runs](int begin, int end) {
+        for (int t = begin; t < end; ++t) ++runs[t];
+      });
+      CHECK(scheduler.threads() >= 1);
+      CHECK(scheduler.threads() <= 4);
+    }
+    CHECK(std::all_of(runs.begin(), runs.end(), [](int r) { return r == 20; }));
+
+    CHECK_THROWS(scheduler.run(weights, [](int, int) {
+      throw std::runtime_error{"task failed"};
+    }));
+
+    // the same pool threads serve every run, also after a failed one
+    std::mutex ids_mutex;
+    std::vector<std::thread::id> ids;
+    for (int k = 0; k < 50; ++k) {
+      scheduler.run(weights, [&](int, int) {
+        std::lock_guard<std::mutex> lock(ids_mutex);
+        ids.push_back(std::this_thread::get_id());
+      });
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    CHECK(ids.size() <= 4);
+  }
+
+  SUBCASE("Thread count probes and chunk size") {
+    bd::AdaptiveScheduler scheduler(4);
+    CHECK(scheduler.threads() == 4);
+    // one heavy task: the workers finish unevenly
+    std::vector<double> weights(64, 1.);
+    weights[0] = 200.;
+    auto work = [&weights](int begin, int end) {
+      for (int t = begin; t < end; ++t) {
+        std::this_thread::sleep_for(
+            std::chrono::microseconds(static_cast<int>(20 * weights[t])));
+      }
+    };
+    const int chunks = scheduler.chunksPerWorker();
+    for (int k = 0; k < bd::AdaptiveScheduler::probeEvery; ++k) {
+      scheduler.run(weights, work);
+    }
+    CHECK(scheduler.chunksPerWorker() > chunks);
+    // after probeEvery runs one thread less is tried
+    CHECK(scheduler.threads() == 3);
+  }
+
+  SUBCASE("Parallel flock update") {
+    bd::Parameters par{60, 10, 0.1, 0.1, 0.01};
+    const bd::Flock initial = seededFlock(600, 8, par);
+
+    // every boid sees the flock as it was at the start of the step
+    bd::Flock jacobi = initial;
+    for (int step = 0; step < 10; ++step) {
+      const std::vector<bd::Boid> start = jacobi.flock();
+      for (int i = 0; i < jacobi.size(); ++i) {
+        bd::Boid b = start[i];
+        b.update(start, 0.05);
+        jacobi.setBoid(i, b);
+      }
+    }
+
+    bd::Flock one = initial;
+    bd::Flock four = initial;
+    one.setScheduler(std::make_shared<bd::AdaptiveScheduler>(1));
+    four.setScheduler(std::make_shared<bd::AdaptiveScheduler>(4));
+    four.setOrderTracking(true);
+    for (int step = 0; step < 10; ++step) {
+      one.updateFlock(0.05);
+      four.updateFlock(0.05);
+    }
+    CHECK(bd::divergence(one, jacobi).position == 0.);
+    CHECK(bd::divergence(one, jacobi).velocity == 0.);
+    CHECK(bd::divergence(four, jacobi).position == 0.);
+    CHECK(bd::divergence(four, jacobi).velocity == 0.);
+    const double polarization = four.orderParameters().polarization;
+    four.mutate();  // invalidates the cache
+    CHECK(four.orderParameters().polarization ==
+          doctest::Approx(polarization));
+
+    // with a field of view, the same for any number of threads
+    one = initial;
+    four = initial;
+    one.setPerception(bd::Perception::cone(270, 5));
+    four.setPerception(bd::Perception::cone(270, 5));
+    one.setScheduler(std::make_shared<bd::AdaptiveScheduler>(1));
+    four.setScheduler(std::make_shared<bd::AdaptiveScheduler>(4));
+    for (int step = 0; step < 10; ++step) {
+      one.updateFlock(0.05);
+      four.updateFlock(0.05);
+    }
+    CHECK(bd::divergence(one, four).position == 0.);
+    CHECK(bd::divergence(one, initial).position > 0.);
+  }
+}
+
+TEST_CASE("Testing the compact state") {
+  bd::Parameters par{60, 10, 0.1, 0.1, 0.01};
+  const bd::Flock initial = seededFlock(2000, 17, par);
+  bd::CompactFlock compact(initial);
+
+  SUBCASE("Size and quantization error") {
+    CHECK(compact.size() == 2000);
+    CHECK(compact.bytes() * 4 < 2000 * sizeof(bd::Boid));
+    CHECK(compact.positionError() < 1e-3);
+    CHECK(compact.velocityError() < 2e-3);
+
+    bd::Divergence div = bd::divergence(compact.toFlock(), initial);
+    CHECK(div.position <= std::sqrt(2.) * compact.positionError());
+    CHECK(div.velocity <= std::sqrt(2.) * compact.velocityError());
+  }
+
+  SUBCASE("A step stays within the error of the full precision one") {
+    // Jacobi step in double precision from the decoded state
+    bd::Flock exact = compact.toFlock();
+    const std::vector<bd::Boid> start = exact.flock();
+    for (int i = 0; i < exact.size(); ++i) {
+      bd::Boid b = start[i];
+      b.update(start, 0.05);
+      exact.setBoid(i, b);
+    }
+    compact.updateFlock(0.05);
+
+    bd::Divergence div = bd::divergence(compact.toFlock(), exact);
+    CHECK(div.position <= std::sqrt(2.) * compact.positionError() + 1e-9);
+    CHECK(div.velocity <= std::sqrt(2.) * compact.velocityError() + 1e-9);
+  }
+
+  SUBCASE("Parallel cells give the same state") {
+    bd::CompactFlock serial(initial);
+    bd::CompactFlock parallel(initial);
+    parallel.setScheduler(std::make_shared<bd::AdaptiveScheduler>(4));
+    for (int step = 0; step < 5; ++step) {
+      serial.updateFlock(0.05);
+      parallel.updateFlock(0.05);
+    }
+    bd::Divergence div = bd::divergence(serial.toFlock(), parallel.toFlock());
+    CHECK(div.position == 0.);
+    CHECK(div.velocity == 0.);
+    CHECK(bd::divergence(serial.toFlock(), initial).position > 0.);
+  }
+}
+
+TEST_CASE("Testing the cached observables") {
+  bd::Flock flock;
+  bd::Boid a(10, 10);
+  a.setVelocity({3, 4});
+  bd::Boid b(1270, 710);
+  b.setVelocity({6, 8});
+  flock.addBoid(a);
+  flock.addBoid(b);
+  const std::uint64_t g = flock.generation();
+
+  const bd::Statistics speed = flock.average_speed();
+  CHECK(speed.mean == doctest::Approx(7.5));
+  CHECK(flock.average_speed().mean == speed.mean);
+  CHECK_THROWS(flock.average_distance());  // a single pair
+
+  const bd::Bounds box = flock.bounds();
+  CHECK(box.min.x == 10);
+  CHECK(box.max.y == 710);
+  // the two boids are 20 apart across the corner of the world
+  CHECK(flock.centroid().x == doctest::Approx(0));
+  CHECK(flock.centroid().y == doctest::Approx(0));
+
+  const bd::SpatialGrid& grid = flock.spatialIndex(100);
+  CHECK(&flock.spatialIndex(100) == &grid);
+  CHECK(flock.spatialIndex(100).cellSize(0) == 1);
+  // reading does not change the generation
+  CHECK(flock.flock().size() == 2);
+  CHECK(flock.getBoid(1).getVelocity().x == 6);
+  CHECK(flock.generation() == g);
+
+  // any change makes the observables stale
+  flock.mutate()[0].setVelocity({0, 1});
+  CHECK(flock.generation() > g);
+  CHECK(flock.average_speed().mean == doctest::Approx(5.5));
+
+  flock.mutate()[1].setPosition({500, 300});
+  CHECK(flock.bounds().max.x == 500);
+  CHECK(flock.spatialIndex(100).cellSize(0) == 1);
+  CHECK(flock.spatialIndex(100).cellSize(flock.spatialIndex(100).cellOf(
+            {500, 300})) == 1);
+
+  // a change through a held handle after a query is seen once the handle
+  // is gone
+  {
+    const bd::Flock::Mutation boids = flock.mutate();
+    bd::Boid& held = boids[0];
+    CHECK(flock.average_speed().mean == doctest::Approx(5.5));
+    held.setVelocity({0, 20});
+  }
+  CHECK(flock.average_speed().mean == doctest::Approx(15));
+  flock.setBoid(0, flock.getBoid(1));
+  CHECK(flock.average_speed().mean == doctest::Approx(10));
+
+  const std::uint64_t before = flock.generation();
+  flock.mutate()[0].setMaxspeed(100);
+  flock.mutate()[1].setMaxspeed(100);
+  flock.updateFlock(0.1);
+  CHECK(flock.generation() > before);
+}
+
+TEST_CASE("Testing the pipelined runner") {
+  bd::Parameters par{60, 10, 0.1, 0.1, 0.01};
+  const bd::Flock initial = seededFlock(200, 4, par);
+  const bd::Engine engine = [](bd::Flock& f, double dt) { f.updateFlock(dt); };
+
+  SUBCASE("Stages see every step in order") {
+    std::vector<double> expected;
+    std::vector<double> expected_distances;
+    std::vector<double> expected_polarizations;
+    bd::Flock serial = initial;
+    serial.setOrderTracking(true);
+    for (int step = 0; step < 20; ++step) {
+      expected.push_back(serial.average_speed().mean);
+      expected_distances.push_back(serial.average_distance().mean);
+      expected_polarizations.push_back(serial.orderParameters().polarization);
+      serial.updateFlock(0.05);
+    }
+
+    std::vector<double> speeds;
+    std::vector<double> distances;
+    std::vector<double> polarizations;
+    std::vector<int> frames;
+    bd::PipelinedRunner runner(2);
+    runner.addStage([&](const bd::Snapshot& s) {
+      CHECK(s.size() == 200);
+      CHECK(s.has_order);
+      speeds.push_back(bd::speedStatistics(s.velocities).mean);
+      distances.push_back(bd::distanceStatistics(s.positions).mean);
+      polarizations.push_back(s.order.polarization);
+    });
+    runner.addStage([&frames](const bd::Snapshot& s) {
+      frames.push_back(s.step);
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    });
+    bd::Flock flock = initial;
+    flock.setOrderTracking(true);
+    runner.run(flock, engine, 20, 0.05);
+
+    CHECK(speeds == expected);
+    CHECK(distances == expected_distances);
+    CHECK(polarizations == expected_polarizations);
+    CHECK(frames.size() == 20);
+    CHECK(std::is_sorted(frames.begin(), frames.end()));
+    CHECK(bd::divergence(flock, serial).position == 0.);
+  }
+
+  SUBCASE("Backpressure and overlap") {
+    std::atomic<int> computed{0};
+    int ahead = 0;
+    bd::PipelinedRunner runner(2);
+    runner.addStage([&](const bd::Snapshot& s) {
+      ahead = std::max(ahead, computed.load() - s.step);
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    });
+    bd::Engine slow = [&computed](bd::Flock&, double) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      ++computed;
+    };
+    bd::Flock flock = initial;
+    const auto start = std::chrono::steady_clock::now();
+    runner.run(flock, slow, 20, 0.05);
+    const double elapsed = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    // the engine is never more than the queue plus the step in the stage
+    // ahead, and the two 5 ms costs overlap
+    CHECK(ahead <= 3);
+    CHECK(elapsed < 0.75 * 20 * 0.010);
+  }
+
+  SUBCASE("Errors of a stage") {
+    bd::PipelinedRunner runner(1);
+    runner.addStage([](const bd::Snapshot& s) {
+      if (s.step == 3) throw std::runtime_error{"stage failed"};
+    });
+    bd::Flock flock = initial;
+    CHECK_THROWS(runner.run(flock, engine, 50, 0.05));
+    CHECK_THROWS(bd::PipelinedRunner(0));
+  }
+}
+
+TEST_CASE("Testing the hashed grid") {
+  // a dense disc in an otherwise sparse world, and points on the borders
+  std::default_random_engine eng(21);
+  std::uniform_real_distribution<double> unit(0, 1);
+  std::vector<sf::Vector2<double>> points;
+  for (int i = 0; i < 5000; ++i) {
+    const double r = 200 * std::sqrt(unit(eng));
+    const double phi = 2 * M_PI * unit(eng);
+    points.push_back({640 + r * std::cos(phi), 360 + r * std::sin(phi)});
+  }
+  for (int i = 0; i < 200; ++i) {
+    points.push_back({unit(eng) * bd::worldWidth, unit(eng) * bd::worldHeight});
+  }
+  points.push_back({0., 0.});
+  points.push_back({bd::worldWidth, 100.});
+  points.push_back({1279.9, bd::worldHeight});
+  const int N = points.size();
+  const double d = 60.;
+
+  bd::HashedGrid hashed(d);
+  hashed.build(points);
+  bd::SpatialGrid uniform(d);
+  uniform.build(points);
+
+  SUBCASE("Every neighbour is a candidate") {
+    long neighbours = 0;
+    long hashed_candidates = 0;
+    long uniform_candidates = 0;
+    long missed = 0;
+    std::vector<int> candidates;
+    for (int i = 0; i < N; i += 7) {
+      hashed.candidates(points[i], d, candidates);
+      CHECK(std::is_sorted(candidates.begin(), candidates.end()));
+      hashed_candidates += candidates.size();
+      for (int j = 0; j < N; ++j) {
+        const sf::Vector2<double> r = bd::minimumImage(points[i], points[j]);
+        if (r.x * r.x + r.y * r.y < d * d) {
+          ++neighbours;
+          missed +=
+              !std::binary_search(candidates.begin(), candidates.end(), j);
+        }
+      }
+      uniform.candidates(points[i], candidates);
+      uniform_candidates += candidates.size();
+    }
+    CHECK(missed == 0);
+    // the 3x3 block is about three times the disc of radius d
+    CHECK(hashed_candidates < 2 * neighbours);
+    CHECK(hashed_candidates < 0.7 * uniform_candidates);
+  }
+
+  SUBCASE("Leaves and memory") {
+    std::vector<int> seen;
+    for (int l = 0; l < hashed.leaves(); ++l) {
+      seen.insert(seen.end(), hashed.leafBegin(l), hashed.leafEnd(l));
+    }
+    std::sort(seen.begin(), seen.end());
+    CHECK(seen.size() == static_cast<std::size_t>(N));
+    CHECK(std::adjacent_find(seen.begin(), seen.end()) == seen.end());
+    CHECK(hashed.occupiedCells() <= hashed.columns() * hashed.rows());
+
+    // one pixel cells: nearly a million cells, only the occupied stored
+    bd::HashedGrid fine(1.);
+    fine.build(std::vector<sf::Vector2<double>>(points.begin(),
+                                                points.begin() + 100));
+    CHECK(fine.occupiedCells() <= 100);
+    // a dense index of the cells alone would take 4 bytes per cell
+    CHECK(fine.bytes() < 100000);
+    std::vector<int> candidates;
+    fine.candidates(points[0], 1., candidates);
+    CHECK(std::binary_search(candidates.begin(), candidates.end(), 0));
+    CHECK_THROWS(fine.candidates(points[0], 2., candidates));
+    CHECK_THROWS(bd::HashedGrid(0.));
+    CHECK_THROWS(bd::HashedGrid(10., 0));
+  }
+}
+
+TEST_CASE("Testing the bulk construction") {
+  const bd::Parameters par{60, 10, 0.1, 0.1, 0.01};
+
+  SUBCASE("Same boids as one by one") {
+    auto init = [](int i, sf::Vector2<double>& p, sf::Vector2<double>& v) {
+      p = {i % 1280 + 0.5, i / 1280 + 0.25};
+      v = {i * 0.01, -i * 0.02};
+    };
+    const bd::Flock bulk = bd::bulkFlock(20000, par, 100, init, 4);
+    bd::Flock single;
+    single.reserve(20000);
+    for (int i = 0; i < 20000; ++i) {
+      sf::Vector2<double> p, v;
+      init(i, p, v);
+      bd::Boid b(p.x, p.y);
+      b.setVelocity(v);
+      b.setMaxspeed(100);
+      b.setPar(par);
+      single.addBoid(b);
+    }
+    CHECK(bd::divergence(bulk, single).position == 0.);
+    CHECK(bd::divergence(bulk, single).velocity == 0.);
+    CHECK(bulk.getBoid(19999).getMaxspeed() == 100.);
+    CHECK(bulk.getBoid(123).getPar().ds == 10.);
+
+    // validated once, before anything is allocated
+    CHECK_THROWS(bd::bulkFlock(10, {60, 70, 0.1, 0.1, 0.01}, 100, init));
+    CHECK_THROWS(bd::bulkFlock(-1, par, 100, init));
+    CHECK_THROWS(bd::bulkFlock(10000, par, 100,
+                               [](int i, sf::Vector2<double>&,
+                                  sf::Vector2<double>&) {
+                                 if (i == 9999) {
+                                   throw std::runtime_error{"bad boid"};
+                                 }
+                               }));
+    bd::Flock flock = single;
+    CHECK_THROWS(flock.setParameters({60, 10, 2., 0.1, 0.01}));
+    CHECK(flock.getBoid(0).getPar().s == 0.1);
+  }
+
+  SUBCASE("Uniform flocks do not depend on the threads") {
+    const bd::Flock one = bd::uniformFlock(30000, par, 100, 50, 7, 1);
+    const bd::Flock many = bd::uniformFlock(30000, par, 100, 50, 7, 8);
+    CHECK(bd::divergence(one, many).position == 0.);
+    CHECK(bd::divergence(one, many).velocity == 0.);
+    const bd::Bounds box = one.bounds();
+    CHECK(box.min.x >= 0.);
+    CHECK(box.max.x < bd::worldWidth);
+    CHECK(box.max.y < bd::worldHeight);
+    CHECK(one.average_speed().mean > 10.);
+    CHECK(bd::divergence(one, bd::uniformFlock(30000, par, 100, 50, 8))
+              .position > 0.);
+  }
+
+  SUBCASE("Initial conditions files") {
+    const bd::Flock initial = bd::uniformFlock(5000, par, 100, 50, 3);
+    const std::string path = "bulk_test.init";
+    bd::saveInitialConditions(path, initial);
+    const bd::Flock loaded = bd::loadInitialConditions(path, par, 100, 4);
+    CHECK(loaded.size() == 5000);
+    CHECK(bd::divergence(loaded, initial).position == 0.);
+    CHECK(bd::divergence(loaded, initial).velocity == 0.);
+
+    // a truncated file and a file of another kind
+    std::ifstream in(path, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)),
+                      std::istreambuf_iterator<char>());
+    in.close();
+    std::ofstream(path, std::ios::binary) << bytes.substr(0, bytes.size() - 8);
+    CHECK_THROWS(bd::loadInitialConditions(path, par, 100));
+    std::ofstream(path, std::ios::binary) << "not a flock";
+    CHECK_THROWS(bd::loadInitialConditions(path, par, 100));
+    std::remove(path.c_str());
+    CHECK_THROWS(bd::loadInitialConditions(path, par, 100));
+  }
+}
+
+TEST_CASE("Testing the adaptive substeps") {
+  const bd::Parameters par{60, 10, 0.5, 0.1, 0.01};
+
+  SUBCASE("Slow flocks take one step") {
+    const bd::Flock initial = seededFlock(300, 5, par);
+    bd::Flock plain = initial;
+    bd::Flock adaptive = initial;
+    adaptive.setSubsteps(8);
+    for (int step = 0; step < 10; ++step) {
+      plain.updateFlock(0.01);
+      adaptive.updateFlock(0.01);
+      CHECK(adaptive.extraSubsteps() == 0);
+    }
+    CHECK(bd::divergence(plain, adaptive).position == 0.);
+    CHECK(bd::divergence(plain, adaptive).velocity == 0.);
+    CHECK_THROWS(adaptive.setSubsteps(0));
+    CHECK_THROWS(adaptive.setSubsteps(4, 0.));
+  }
+
+  SUBCASE("Head-on encounter") {
+    // two boids closing at 800 px/s, 4 px apart sideways, and a slow one
+    // far away
+    auto encounter = [&par]() {
+      bd::Flock flock;
+      const sf::Vector2<double> states[3][2] = {{{600, 360}, {400, 0}},
+                                                {{650, 364}, {-400, 0}},
+                                                {{100, 100}, {10, 0}}};
+      for (const auto& s : states) {
+        bd::Boid b(s[0].x, s[0].y);
+        b.setVelocity(s[1]);
+        b.setMaxspeed(500);
+        b.setPar(par);
+        flock.addBoid(b);
+      }
+      return flock;
+    };
+
+    // in one step they jump over the separation radius: only cohesion
+    // pulls them, towards each other
+    bd::Flock plain = encounter();
+    plain.updateFlock(0.1);
+    CHECK(plain.getBoid(0).getVelocity().y > 0.);
+
+    // about 800 * 0.1 / (0.5 * 10) = 16 substeps each, and separation
+    // pushes them apart while they pass
+    bd::Flock adaptive = encounter();
+    adaptive.setSubsteps(32);
+    adaptive.updateFlock(0.1);
+    // the second one counts its substeps on the first already slowed down
+    // by alignment, but moves it from where it was at the start of the step
+    CHECK(adaptive.extraSubsteps() >= 28);
+    CHECK(adaptive.extraSubsteps() <= 30);
+    CHECK(adaptive.getBoid(0).getVelocity().y < 0.);
+    CHECK(adaptive.getBoid(1).getVelocity().y > 0.);
+    CHECK(adaptive.getBoid(2).getPosition().x == doctest::Approx(101.));
+
+    bd::Flock capped = encounter();
+    capped.setSubsteps(4);
+    capped.updateFlock(0.1);
+    CHECK(capped.extraSubsteps() == 6);
+
+    bd::Flock parallel = encounter();
+    parallel.setSubsteps(32);
+    parallel.setScheduler(std::make_shared<bd::AdaptiveScheduler>(2));
+    parallel.updateFlock(0.1);
+    // both see the other as it was: exactly 16 substeps each
+    CHECK(parallel.extraSubsteps() == 30);
+    CHECK(parallel.getBoid(0).getVelocity().y < 0.);
+  }
+}
+
+TEST_CASE("Testing the shared memory publishing") {
+  const bd::Parameters par{60, 10, 0.1, 0.1, 0.01};
+  const std::string name = "/boid_test_" + std::to_string(::getpid());
+
+  SUBCASE("Frames published by the flock") {
+    auto publisher = std::make_shared<bd::SnapshotPublisher>(name, 500, 3);
+    bd::SnapshotReader reader(name);
+    CHECK(reader.capacity() == 500);
+    CHECK(reader.slots() == 3);
+    bd::Frame frame;
+    CHECK_FALSE(reader.latest(frame));
+
+    bd::Flock flock = seededFlock(400, 9, par);
+    flock.setPublisher(publisher);
+    for (int step = 0; step < 10; ++step) flock.updateFlock(0.05);
+    CHECK(reader.published() == 10);
+    REQUIRE(reader.latest(frame));
+    CHECK(frame.frame == 9);
+    CHECK(frame.generation == flock.generation());
+    REQUIRE(frame.size() == 400);
+    bool same = true;
+    for (int i = 0; i < 400; ++i) {
+      const bd::Boid& b = flock.flock()[i];
+      same = same && frame.x[i] == b.getPosition().x &&
+             frame.y[i] == b.getPosition().y &&
+             frame.vx[i] == b.getVelocity().x &&
+             frame.vy[i] == b.getVelocity().y;
+    }
+    CHECK(same);
+
+    CHECK_THROWS(publisher->publish(seededFlock(501, 1, par)));
+    CHECK_THROWS(bd::SnapshotPublisher("no_slash", 10));
+    CHECK_THROWS(bd::SnapshotPublisher(name + "x", 10, 0));
+  }
+
+  SUBCASE("Readers never see a torn frame") {
+    bd::SnapshotPublisher publisher(name, 2000, 2);
+    bd::Flock flock = seededFlock(2000, 3, par);
+    std::atomic<bool> done{false};
+    long frames = 0;
+    long torn = 0;
+    std::thread reader_thread([&] {
+      bd::SnapshotReader reader(name);
+      bd::Frame frame;
+      while (!done) {
+        if (!reader.latest(frame, 1)) continue;
+        ++frames;
+        // every boid of frame f is at x = f
+        torn += std::count_if(frame.x.begin(), frame.x.end(), [&](double x) {
+          return x != static_cast<double>(frame.frame);
+        }) > 0;
+      }
+    });
+    for (int f = 0; f < 2000; ++f) {
+      for (auto& boid : flock.mutate()) boid.setPosition({double(f), 0.});
+      publisher.publish(flock);
+    }
+    done = true;
+    reader_thread.join();
+    CHECK(publisher.published() == 2000);
+    CHECK(frames > 0);
+    CHECK(torn == 0);
+  }
+
+  CHECK_THROWS(bd::SnapshotReader(name));
+}
+
+// the parameters of the tests above, as compile-time constants
+struct TestParameters {
+  static constexpr double d{60};
+  static constexpr double ds{10};
+  static constexpr double s{0.1};
+  static constexpr double a{0.1};
+  static constexpr double c{0.01};
+  static constexpr double maxspeed{100};
+};
+
+TEST_CASE("Testing the compile-time parameters") {
+  using Fixed = bd::FixedFlock<TestParameters>;
+  const bd::Parameters par = Fixed::parameters();
+
+  SUBCASE("One step agrees with Flock up to rounding") {
+    // 203 boids: whole lanes and a remainder
+    bd::Flock flock = seededFlock(203, 4, par);
+    Fixed fixed = Fixed::fromFlock(flock);
+    REQUIRE(fixed.size() == 203);
+    flock.updateFlock(0.05);
+    fixed.updateFlock(0.05);
+    double worst = 0.;
+    for (int i = 0; i < fixed.size(); ++i) {
+      const bd::Boid& b = flock.flock()[i];
+      worst = std::max({worst,
+                        std::abs(fixed.position(i).x - b.getPosition().x),
+                        std::abs(fixed.position(i).y - b.getPosition().y),
+                        std::abs(fixed.velocity(i).x - b.getVelocity().x),
+                        std::abs(fixed.velocity(i).y - b.getVelocity().y)});
+    }
+    CHECK(worst < 1e-9);
+  }
+
+  SUBCASE("The kernel of one boid") {
+    bd::Flock flock = seededFlock(50, 6, par);
+    Fixed fixed = Fixed::fromFlock(flock);
+    std::vector<double> x, y, vx, vy;
+    for (int i = 0; i < fixed.size(); ++i) {
+      x.push_back(fixed.position(i).x);
+      y.push_back(fixed.position(i).y);
+      vx.push_back(fixed.velocity(i).x);
+      vy.push_back(fixed.velocity(i).y);
+    }
+    const bd::BoidClass c{par, TestParameters::maxspeed};
+    bd::BoidState runtime{x[7], y[7], vx[7], vy[7]};
+    bd::BoidState compiled = runtime;
+    bd::updateState(runtime, c, x.data(), y.data(), vx.data(), vy.data(), 50,
+                    0.05);
+    bd::updateStateFixed<TestParameters>(compiled, x.data(), y.data(),
+                                         vx.data(), vy.data(), 50, 0.05);
+    CHECK(compiled.x == doctest::Approx(runtime.x).epsilon(1e-12));
+    CHECK(compiled.y == doctest::Approx(runtime.y).epsilon(1e-12));
+    CHECK(compiled.vx == doctest::Approx(runtime.vx).epsilon(1e-12));
+    CHECK(compiled.vy == doctest::Approx(runtime.vy).epsilon(1e-12));
+  }
+
+  SUBCASE("Conversions") {
+    bd::Flock flock = seededFlock(30, 8, par);
+    const bd::Flock back = Fixed::fromFlock(flock).toFlock();
+    REQUIRE(back.size() == 30);
+    bool same = true;
+    for (int i = 0; i < 30; ++i) {
+      const bd::Boid& a = flock.flock()[i];
+      const bd::Boid& b = back.flock()[i];
+      same = same && a.getPosition() == b.getPosition() &&
+             a.getVelocity() == b.getVelocity() &&
+             b.getMaxspeed() == TestParameters::maxspeed &&
+             b.getPar().ds == par.ds;
+    }
+    CHECK(same);
+
+    flock.mutate()[12].setMaxspeed(50);
+    CHECK_THROWS(Fixed::fromFlock(flock));
+    CHECK_THROWS(Fixed::fromFlock(
+        seededFlock(30, 8, bd::Parameters{60, 10, 0.2, 0.1, 0.01})));
+    using Standard = bd::FixedFlock<bd::StandardParameters>;
+    CHECK_NOTHROW(bd::validate(Standard::parameters()));
+  }
+}
@@ -0,0 +1,182 @@
+#include "bulk.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace bd {
+
+namespace {
+
+const char magic[8] = {'B', 'O', 'I', 'D', 'I', 'N', 'I', 'T'};
+const std::uint32_t version = 1;
+const std::size_t header = 24;
+const std::size_t record = 4 * sizeof(double);
+
+// splitmix64: a good 64-bit hash of a counter
+std::uint64_t mix(std::uint64_t z) {
+  z += 0x9e3779b97f4a7c15ull;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+// uniform in [0, 1)
+double unit(std::uint64_t z) { return (z >> 11) * 0x1.0p-53; }
+
+// the read-only mapping of a whole file
+struct Mapping {
+  const unsigned char* data{};
+  std::size_t size{};
+
+  explicit Mapping(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error{"Could not open " + path + "."};
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw std::runtime_error{"Could not open " + path + "."};
+    }
+    size = st.st_size;
+    if (size > 0) {
+      void* p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error{"Could not map " + path + "."};
+      }
+      data = static_cast<const unsigned char*>(p);
+    }
+    // the mapping stays valid after the descriptor is closed
+    ::close(fd);
+  }
+  ~Mapping() {
+    if (data) ::munmap(const_cast<unsigned char*>(data), size);
+  }
+  Mapping(const Mapping&) = delete;
+  Mapping& operator=(const Mapping&) = delete;
+};
+
+}  // namespace
+
+Flock bulkFlock(int N, const Parameters& par, double maxspeed,
+                const BoidInit& init, int threads) {
+  if (N < 0) {
+    throw std::runtime_error{
+        "Something went wrong. The number of boids must be positive.\n"};
+  }
+  validate(par);
+
+  Flock flock;
+  {
+    const Flock::Mutation mutation = flock.mutate();
+    auto& boids = mutation.boids();
+    boids.resize(N);
+
+    if (threads <= 0) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // small flocks are not worth a thread
+    threads = std::max(1, std::min(threads, N / 4096));
+    auto fill = [&](int begin, int end) {
+      sf::Vector2<double> position;
+      sf::Vector2<double> velocity;
+      for (int i = begin; i < end; ++i) {
+        init(i, position, velocity);
+        boids[i] = Boid(position, velocity, par, maxspeed);
+      }
+    };
+    std::vector<std::future<void>> parts;
+    for (int t = 1; t < threads; ++t) {
+      parts.push_back(std::async(std::launch::async, fill,
+                                 static_cast<long>(N) * t / threads,
+                                 static_cast<long>(N) * (t + 1) / threads));
+    }
+    fill(0, static_cast<long>(N) / threads);
+    // rethrows the exception of a part, if any
+    for (auto& part : parts) part.get();
+  }
+  return flock;
+}
+
+Flock uniformFlock(int N, const Parameters& par, double maxspeed, double v0,
+                   std::uint64_t seed, int threads) {
+  const std::uint64_t base = mix(seed);
+  return bulkFlock(
+      N, par, maxspeed,
+      [base, v0](int i, sf::Vector2<double>& position,
+                 sf::Vector2<double>& velocity) {
+        const std::uint64_t z = base + 4 * static_cast<std::uint64_t>(i);
+        position = {unit(mix(z)) * worldWidth,
+                    unit(mix(z + 1)) * worldHeight};
+        velocity = {(2 * unit(mix(z + 2)) - 1) * v0,
+                    (2 * unit(mix(z + 3)) - 1) * v0};
+      },
+      threads);
+}
+
+void saveInitialConditions(const std::string& path, const Flock& flock) {
+  std::ofstream out(path, std::ios::binary);
+  if (!out) {
+    throw std::runtime_error{"Could not open " + path + "."};
+  }
+  const std::uint32_t reserved = 0;
+  const std::uint64_t n = flock.size();
+  out.write(magic, sizeof(magic));
+  out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+  out.write(reinterpret_cast<const char*>(&reserved), sizeof(reserved));
+  out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+  for (const auto& boid : flock.flock()) {
+    const sf::Vector2<double> p = boid.getPosition();
+    const sf::Vector2<double> v = boid.getVelocity();
+    const double values[4] = {p.x, p.y, v.x, v.y};
+    out.write(reinterpret_cast<const char*>(values), sizeof(values));
+  }
+  if (!out) {
+    throw std::runtime_error{"Could not write " + path + "."};
+  }
+}
+
+Flock loadInitialConditions(const std::string& path, const Parameters& par,
+                            double maxspeed, int threads) {
+  const Mapping file(path);
+  if (file.size < header || std::memcmp(file.data, magic, 8) != 0) {
+    throw std::runtime_error{path + " is not an initial conditions file."};
+  }
+  std::uint32_t v;
+  std::uint64_t n;
+  std::memcpy(&v, file.data + 8, sizeof(v));
+  std::memcpy(&n, file.data + 16, sizeof(n));
+  if (v != version) {
+    throw std::runtime_error{path + " has an unknown version."};
+  }
+  if (n > static_cast<std::uint64_t>(std::numeric_limits<int>::max()) ||
+      file.size != header + n * record) {
+    throw std::runtime_error{path + " is truncated."};
+  }
+
+  const unsigned char* records = file.data + header;
+  return bulkFlock(
+      n, par, maxspeed,
+      [records](int i, sf::Vector2<double>& position,
+                sf::Vector2<double>& velocity) {
+        double values[4];
+        std::memcpy(values, records + i * record, record);
+        position = {values[0], values[1]};
+        velocity = {values[2], values[3]};
+      },
+      threads);
+}
+
+}  // namespace bd
@@ -0,0 +1,42 @@
+#pragma once
+#ifndef BULK_HPP
+#define BULK_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "boid.hpp"
+#include "flock.hpp"
+
+namespace bd {
+
+// Construction of large flocks: the parameters are validated once, the
+// boids are allocated once and filled by several threads.
+
+// position and velocity of boid i; called from several threads at once
+using BoidInit = std::function<void(int i, sf::Vector2<double>& position,
+                                    sf::Vector2<double>& velocity)>;
+
+// N boids sharing par and maxspeed (threads: 0 for one per core)
+Flock bulkFlock(int N, const Parameters& par, double maxspeed,
+                const BoidInit& init, int threads = 0);
+
+// positions uniform over the world, velocity components uniform in
+// [-v0, v0]. Every boid draws from its own counter-based stream, so the
+// flock depends on the seed only, not on the number of threads. Not the
+// same draw as randomFlock of ensemble.hpp, which takes one
+// std::default_random_engine stream and velocities in [-1, 1].
+Flock uniformFlock(int N, const Parameters& par, double maxspeed, double v0,
+                   std::uint64_t seed, int threads = 0);
+
+// Initial conditions file: "BOIDINIT", a 32-bit version, 32 reserved bits,
+// a 64-bit boid count, then x, y, vx, vy of every boid as native doubles.
+void saveInitialConditions(const std::string& path, const Flock& flock);
+// maps the file into memory and fills the flock from it in parallel
+Flock loadInitialConditions(const std::string& path, const Parameters& par,
+                            double maxspeed, int threads = 0);
+
+}  // namespace bd
+
+#endif
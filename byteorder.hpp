@@ -0,0 +1,69 @@
+#pragma once
+#ifndef BYTEORDER_HPP
+#define BYTEORDER_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <istream>
+#include <ostream>
+
+namespace bd {
+
+// Binary files (statistics, golden trajectories) are little endian
+// whatever the machine writing or reading them.
+inline bool littleEndian() {
+  const std::uint16_t one = 1;
+  unsigned char first;
+  std::memcpy(&first, &one, 1);
+  return first == 1;
+}
+
+// value in little endian order, or back to the native one
+template <class T>
+T little(T value) {
+  if (littleEndian()) return value;
+  unsigned char bytes[sizeof(T)];
+  std::memcpy(bytes, &value, sizeof(T));
+  std::reverse(bytes, bytes + sizeof(T));
+  std::memcpy(&value, bytes, sizeof(T));
+  return value;
+}
+
+// true if all the values were written
+template <class T>
+bool putLittle(std::FILE* file, const T* values, std::size_t n) {
+  if (littleEndian()) return std::fwrite(values, sizeof(T), n, file) == n;
+  for (std::size_t i = 0; i < n; ++i) {
+    const T v = little(values[i]);
+    if (std::fwrite(&v, sizeof(T), 1, file) != 1) return false;
+  }
+  return true;
+}
+
+template <class T>
+bool putLittle(std::ostream& out, const T* values, std::size_t n) {
+  if (littleEndian()) {
+    return static_cast<bool>(out.write(
+        reinterpret_cast<const char*>(values), n * sizeof(T)));
+  }
+  for (std::size_t i = 0; i < n; ++i) {
+    const T v = little(values[i]);
+    out.write(reinterpret_cast<const char*>(&v), sizeof(T));
+  }
+  return static_cast<bool>(out);
+}
+
+// true if all the values were read
+template <class T>
+bool readLittle(std::istream& in, T* values, std::size_t n) {
+  if (!in.read(reinterpret_cast<char*>(values), n * sizeof(T))) return false;
+  for (std::size_t i = 0; i < n; ++i) values[i] = little(values[i]);
+  return true;
+}
+
+}  // namespace bd
+
+#endif
@@ -0,0 +1,118 @@
+#include "classed.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+namespace bd {
+
+void ClassedFlock::checkClass(int k) const {
+  if (k < 0 || k >= classes()) {
+    throw std::runtime_error{"Something went wrong. No boid class " +
+                             std::to_string(k) + ".\n"};
+  }
+}
+
+int ClassedFlock::addClass(const BoidClass& c) {
+  if (classes() == maxClasses) {
+    throw std::runtime_error{
+        "Something went wrong. A flock has at most 256 boid classes.\n"};
+  }
+  Boid check;
+  check.setPar(c.par);  // same checks as for a single boid
+  table.push_back(c);
+  return classes() - 1;
+}
+
+void ClassedFlock::setClass(int k, const BoidClass& c) {
+  checkClass(k);
+  Boid check;
+  check.setPar(c.par);  // same checks as for a single boid
+  table[k] = c;
+}
+
+const BoidClass& ClassedFlock::boidClass(int k) const {
+  checkClass(k);
+  return table[k];
+}
+
+void ClassedFlock::addBoid(const sf::Vector2<double>& position,
+                           const sf::Vector2<double>& velocity, int k) {
+  checkClass(k);
+  x.push_back(position.x);
+  y.push_back(position.y);
+  vx.push_back(velocity.x);
+  vy.push_back(velocity.y);
+  cls.push_back(k);
+}
+
+void ClassedFlock::setClassOf(int i, int k) {
+  checkClass(k);
+  cls[i] = k;
+}
+
+Boid ClassedFlock::getBoid(int i) const {
+  Boid b(x[i], y[i]);
+  b.setVelocity({vx[i], vy[i]});
+  b.setPar(table[cls[i]].par);
+  b.setMaxspeed(table[cls[i]].maxspeed);
+  return b;
+}
+
+ClassedFlock ClassedFlock::fromFlock(const Flock& flock) {
+  ClassedFlock classed;
+  for (const Boid& b : flock.flock()) {
+    const Parameters p = b.getPar();
+    int k = 0;
+    for (; k < classed.classes(); ++k) {
+      const BoidClass& c = classed.table[k];
+      if (c.par.d == p.d && c.par.ds == p.ds && c.par.s == p.s &&
+          c.par.a == p.a && c.par.c == p.c &&
+          c.maxspeed == b.getMaxspeed()) {
+        break;
+      }
+    }
+    if (k == classed.classes()) {
+      classed.addClass({p, b.getMaxspeed()});
+    }
+    classed.addBoid(b.getPosition(), b.getVelocity(), k);
+  }
+  return classed;
+}
+
+Flock ClassedFlock::toFlock() const {
+  Flock flock;
+  for (int i = 0; i < size(); ++i) {
+    flock.addBoid(getBoid(i));
+  }
+  return flock;
+}
+
+// the class as the kernel sees it
+struct ClassValues {
+  double d, ds, s, a, c, maxspeed;
+};
+
+void updateState(BoidState& st, const BoidClass& c, const double* x,
+                 const double* y, const double* vx, const double* vy, int n,
+                 double const delta_t) {
+  const ClassValues values{c.par.d, c.par.ds, c.par.s,
+                           c.par.a, c.par.c,  c.maxspeed};
+  updateStateWith(st, values, x, y, vx, vy, n, delta_t);
+}
+
+// Boid::update for every boid in turn, each one seeing the boids before it
+// already moved
+void ClassedFlock::updateFlock(double const delta_t) {
+  const int N = size();
+  for (int i = 0; i < N; ++i) {
+    BoidState st{x[i], y[i], vx[i], vy[i]};
+    updateState(st, table[cls[i]], x.data(), y.data(), vx.data(), vy.data(),
+                N, delta_t);
+    x[i] = st.x;
+    y[i] = st.y;
+    vx[i] = st.vx;
+    vy[i] = st.vy;
+  }
+}
+
+}  // namespace bd
@@ -0,0 +1,175 @@
+#pragma once
+#ifndef CLASSED_HPP
+#define CLASSED_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "boid.hpp"
+#include "flock.hpp"
+
+namespace bd {
+
+// parameters and speed limit shared by all the boids of a class (leaders,
+// juveniles, stragglers, ...)
+struct BoidClass {
+  Parameters par;
+  double maxspeed{};
+};
+
+// a boid in full precision, as seen by the array kernels
+struct BoidState {
+  double x{};
+  double y{};
+  double vx{};
+  double vy{};
+};
+
+// Boid::update of a boid of class c among the n boids of the arrays (itself
+// included), with the same arithmetic
+void updateState(BoidState& s, const BoidClass& c, const double* x,
+                 const double* y, const double* vx, const double* vy, int n,
+                 double const delta_t);
+
+// what the rules sum over the neighbours of a boid
+struct RuleSums {
+  double sep_x{}, sep_y{};
+  double ali_x{}, ali_y{};
+  double coh_x{}, coh_y{};
+  int n_ali{}, n_coh{};
+};
+
+// The expressions of Boid::separation, alignment and cohesion, the speed
+// limit, Boid::updatePosition and Boid::borders, given the sums. P has the
+// members s, a, c and maxspeed; the speed limit is the one of
+// Boid::limitSpeed in Exact mode.
+template <class P>
+inline void applyRules(BoidState& st, const P& p, const RuleSums& r,
+                       double const delta_t,
+                       MathMode mode = MathMode::Exact) {
+  const double xi = st.x;
+  const double yi = st.y;
+  const double s = -p.s;
+  double v1x = s * r.sep_x;
+  double v1y = s * r.sep_y;
+  double v2x{}, v2y{};
+  if (r.n_ali > 1) {
+    const double k = p.a * (1.0 / (r.n_ali - 1));
+    v2x = r.ali_x * k;
+    v2y = r.ali_y * k;
+  }
+  double v3x{}, v3y{};
+  if (r.n_coh > 1) {
+    const double k = 1.0 / (r.n_coh - 1);
+    v3x = p.c * ((r.coh_x - xi) * k - xi);
+    v3y = p.c * ((r.coh_y - yi) * k - yi);
+  }
+  double nvx = st.vx + ((v1x + v2x) + v3x);
+  double nvy = st.vy + ((v1y + v2y) + v3y);
+
+  clampSpeed(nvx, nvy, p.maxspeed, mode);
+  st.vx = nvx;
+  st.vy = nvy;
+
+  double px = xi + nvx * delta_t;
+  double py = yi + nvy * delta_t;
+  if (px < 0.) {
+    px = worldWidth;
+  } else if (px > worldWidth) {
+    px = 0;
+  }
+  if (py < 0.) {
+    py = worldHeight;
+  } else if (py > worldHeight) {
+    py = 0;
+  }
+  st.x = px;
+  st.y = py;
+}
+
+// The same kernel for any source of parameters: P has the members d, ds,
+// s, a, c and maxspeed, plain values or static constexpr ones (fixed.hpp),
+// which the compiler then folds into the loop. The constants are read
+// once, then the inner loop over the other boids has no branches: the
+// rules add zero for boids out of range, which leaves the sums unchanged
+// bit for bit.
+template <class P>
+inline void updateStateWith(BoidState& st, const P& p, const double* x,
+                            const double* y, const double* vx,
+                            const double* vy, int n, double const delta_t) {
+  const double half_w = worldWidth / 2;
+  const double half_h = worldHeight / 2;
+  const double d = p.d;
+  const double ds = p.ds;
+  const double xi = st.x;
+  const double yi = st.y;
+  const double vxi = st.vx;
+  const double vyi = st.vy;
+
+  RuleSums r;
+  for (int j = 0; j < n; ++j) {
+    const double dx = x[j] - xi;
+    const double dy = y[j] - yi;
+    // distance() and e_distance()
+    const double wx = dx > half_w ? worldWidth - dx : dx;
+    const double wy = dy > half_h ? worldHeight - dy : dy;
+    const double dist = std::sqrt(wx * wx + wy * wy);
+    const double e_dist = std::sqrt(dx * dx + dy * dy);
+
+    const bool near = dist < d;
+    const bool close = dist < ds;
+    const bool e_near = e_dist < d;
+    r.sep_x += close ? dx : 0.;
+    r.sep_y += close ? dy : 0.;
+    r.ali_x += near ? vx[j] - vxi : 0.;
+    r.ali_y += near ? vy[j] - vyi : 0.;
+    r.n_ali += near;
+    r.coh_x += e_near ? x[j] : 0.;
+    r.coh_y += e_near ? y[j] : 0.;
+    r.n_coh += e_near;
+  }
+  applyRules(st, p, r, delta_t);
+}
+
+// A flock for very many boids: every boid stores only its position, its
+// velocity and a one-byte index into a table of at most 256 classes, in
+// separate arrays. Updated in the same order and with the same arithmetic
+// as Flock::updateFlock, so the two give identical trajectories.
+class ClassedFlock {
+  std::vector<BoidClass> table;
+  std::vector<double> x, y, vx, vy;
+  std::vector<std::uint8_t> cls;
+
+  void checkClass(int k) const;
+
+ public:
+  static constexpr int maxClasses{256};
+
+  // index of the new class
+  int addClass(const BoidClass& c);
+  void setClass(int k, const BoidClass& c);
+  const BoidClass& boidClass(int k) const;
+  int classes() const { return table.size(); }
+
+  int size() const { return cls.size(); }
+  void addBoid(const sf::Vector2<double>& position,
+               const sf::Vector2<double>& velocity, int k);
+  int classOf(int i) const { return cls[i]; }
+  void setClassOf(int i, int k);
+  sf::Vector2<double> position(int i) const { return {x[i], y[i]}; }
+  sf::Vector2<double> velocity(int i) const { return {vx[i], vy[i]}; }
+
+  // the boid with the parameters and speed limit of its class
+  Boid getBoid(int i) const;
+
+  // one class for every distinct pair of parameters and speed limit
+  static ClassedFlock fromFlock(const Flock& flock);
+  Flock toFlock() const;
+
+  void updateFlock(double const delta_t);
+};
+
+}  // namespace bd
+
+#endif
@@ -0,0 +1,142 @@
+#include "cluster.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+#include "grid.hpp"
+
+namespace bd {
+
+ConcurrentUnionFind::ConcurrentUnionFind(int n) : parent(n) {
+  for (int i = 0; i < n; ++i) {
+    parent[i].store(i, std::memory_order_relaxed);
+  }
+}
+
+int ConcurrentUnionFind::find(int i) {
+  while (true) {
+    int p = parent[i].load(std::memory_order_acquire);
+    if (p == i) return i;
+    int gp = parent[p].load(std::memory_order_acquire);
+    // path halving; losing the race only means a longer path
+    if (gp != p) {
+      parent[i].compare_exchange_weak(p, gp, std::memory_order_acq_rel);
+    }
+    i = p;
+  }
+}
+
+void ConcurrentUnionFind::unite(int a, int b) {
+  while (true) {
+    a = find(a);
+    b = find(b);
+    if (a == b) return;
+    if (a < b) std::swap(a, b);
+    int expected = a;
+    if (parent[a].compare_exchange_strong(expected, b,
+                                          std::memory_order_acq_rel)) {
+      return;
+    }
+  }
+}
+
+ClusterAnalysis findClusters(const std::vector<Boid>& boids, double d,
+                             int threads) {
+  const int N = boids.size();
+  std::vector<sf::Vector2<double>> positions(N);
+  std::vector<sf::Vector2<double>> velocities(N);
+  for (int i = 0; i < N; ++i) {
+    positions[i] = boids[i].getPosition();
+    velocities[i] = boids[i].getVelocity();
+  }
+  return findClusters(positions, velocities, d, threads);
+}
+
+ClusterAnalysis findClusters(
+    const std::vector<sf::Vector2<double>>& positions,
+    const std::vector<sf::Vector2<double>>& velocities, double d,
+    int threads) {
+  if (!(d > 0.)) {
+    throw std::runtime_error{
+        "Something went wrong. Parameter d must be positive.\n"};
+  }
+  const int N = positions.size();
+
+  SpatialGrid grid(d);
+  grid.build(positions);
+  ConcurrentUnionFind sets(N);
+
+  if (threads <= 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = std::max(1, std::min(threads, N / 1024 + 1));
+
+  // every worker links the boids of a range of cells to their neighbours
+  auto link = [&](int first_cell, int last_cell) {
+    int around[9];
+    for (int c = first_cell; c < last_cell; ++c) {
+      int n = grid.neighbourCells(c, around);
+      for (const int* i = grid.cellBegin(c); i != grid.cellEnd(c); ++i) {
+        for (int k = 0; k < n; ++k) {
+          for (const int* j = grid.cellBegin(around[k]);
+               j != grid.cellEnd(around[k]); ++j) {
+            if (*j <= *i) continue;  // every pair once
+            sf::Vector2<double> delta =
+                minimumImage(positions[*i], positions[*j]);
+            if (delta.x * delta.x + delta.y * delta.y < d * d) {
+              sets.unite(*i, *j);
+            }
+          }
+        }
+      }
+    }
+  };
+
+  const int C = grid.cells();
+  std::vector<std::thread> workers;
+  for (int w = 1; w < threads; ++w) {
+    workers.emplace_back(link, C * w / threads, C * (w + 1) / threads);
+  }
+  link(0, C / threads);
+  for (auto& t : workers) t.join();
+
+  ClusterAnalysis result;
+  result.label.assign(N, -1);
+  std::vector<int> root_label(N, -1);
+  // centroids are accumulated relative to the first boid of the cluster, so
+  // that clusters crossing the border of the world are not split in two
+  std::vector<sf::Vector2<double>> offsets;
+  for (int i = 0; i < N; ++i) {
+    int root = sets.find(i);
+    if (root_label[root] < 0) {
+      root_label[root] = result.clusters.size();
+      result.clusters.push_back({});
+      offsets.push_back({});
+      result.clusters.back().centroid = positions[i];
+    }
+    int l = root_label[root];
+    Cluster& cl = result.clusters[l];
+    result.label[i] = l;
+    ++cl.size;
+    offsets[l] += minimumImage(cl.centroid, positions[i]);
+    cl.velocity += velocities[i];
+  }
+
+  for (int l = 0, L = result.clusters.size(); l < L; ++l) {
+    Cluster& cl = result.clusters[l];
+    cl.centroid = wrapPosition(cl.centroid +
+                               offsets[l] / static_cast<double>(cl.size));
+    cl.velocity /= static_cast<double>(cl.size);
+
+    int bin = 0;
+    while ((2 << bin) <= cl.size) ++bin;
+    if (static_cast<int>(result.size_histogram.size()) <= bin) {
+      result.size_histogram.resize(bin + 1);
+    }
+    ++result.size_histogram[bin];
+  }
+  return result;
+}
+
+}  // namespace bd
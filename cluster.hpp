@@ -0,0 +1,54 @@
+#pragma once
+#ifndef CLUSTER_HPP
+#define CLUSTER_HPP
+
+#include <atomic>
+#include <vector>
+
+#include "boid.hpp"
+
+namespace bd {
+
+// union-find that many threads can update at the same time: roots are linked
+// with a compare-and-swap, always from the larger index to the smaller one,
+// so no cycle can form.
+class ConcurrentUnionFind {
+  std::vector<std::atomic<int>> parent;
+
+ public:
+  explicit ConcurrentUnionFind(int n);
+
+  int find(int i);
+  void unite(int a, int b);
+};
+
+struct Cluster {
+  int size{};
+  sf::Vector2<double> centroid;  // inside the world, computed on the torus
+  sf::Vector2<double> velocity;  // mean velocity
+};
+
+// sub-flocks: connected components of the graph linking the boids closer
+// than d (periodic distance)
+struct ClusterAnalysis {
+  std::vector<int> label;  // cluster of every boid
+  std::vector<Cluster> clusters;  // ordered by their first boid
+  // size_histogram[k]: number of clusters with 2^k <= size < 2^(k+1)
+  std::vector<int> size_histogram;
+
+  int count() const { return clusters.size(); }
+};
+
+// O(N k) with a spatial grid of cell d, the links are found by threads
+// workers (0: one per core)
+ClusterAnalysis findClusters(const std::vector<Boid>& boids, double d,
+                             int threads = 0);
+// the same on the positions and velocities alone (e.g. of a Snapshot)
+ClusterAnalysis findClusters(
+    const std::vector<sf::Vector2<double>>& positions,
+    const std::vector<sf::Vector2<double>>& velocities, double d,
+    int threads = 0);
+
+}  // namespace bd
+
+#endif
@@ -0,0 +1,266 @@
+#include "command.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace bd {
+
+Command parseCommand(const std::string& line) {
+  std::istringstream in(line);
+  std::string word;
+  Command cmd;
+
+  if (!(in >> word)) {
+    throw std::runtime_error{"Empty command."};
+  }
+
+  if (word == "d" || word == "ds" || word == "s" || word == "a" ||
+      word == "c") {
+    cmd.type = CommandType::SetParameter;
+    cmd.field = word == "d"    ? Field::d
+                : word == "ds" ? Field::ds
+                : word == "s"  ? Field::s
+                : word == "a"  ? Field::a
+                               : Field::c;
+    if (!(in >> cmd.value)) {
+      throw std::runtime_error{"Missing value for parameter " + word + "."};
+    }
+  } else if (word == "spawn") {
+    cmd.type = CommandType::Spawn;
+    if (!(in >> cmd.count >> cmd.x >> cmd.y) || cmd.count < 1) {
+      throw std::runtime_error{"Usage: spawn N X Y"};
+    }
+  } else if (word == "pause") {
+    cmd.type = CommandType::Pause;
+  } else if (word == "resume") {
+    cmd.type = CommandType::Resume;
+  } else if (word == "step") {
+    cmd.type = CommandType::Step;
+    if (!(in >> cmd.count)) cmd.count = 1;
+    if (cmd.count < 1) {
+      throw std::runtime_error{"Usage: step [N]"};
+    }
+  } else if (word == "snapshot") {
+    cmd.type = CommandType::Snapshot;
+    if (!(in >> cmd.path)) {
+      throw std::runtime_error{"Usage: snapshot PATH"};
+    }
+  } else {
+    throw std::runtime_error{"Unknown command '" + word + "'."};
+  }
+  return cmd;
+}
+
+CommandQueue::CommandQueue() : head(&stub), tail(&stub) {}
+
+CommandQueue::~CommandQueue() {
+  Command cmd;
+  while (pop(cmd)) {
+  }
+}
+
+void CommandQueue::pushNode(Node* n) {
+  n->next.store(nullptr, std::memory_order_relaxed);
+  Node* prev = head.exchange(n, std::memory_order_acq_rel);
+  // between the exchange and this store the list is briefly disconnected,
+  // pop() sees it as empty until the link is published
+  prev->next.store(n, std::memory_order_release);
+}
+
+void CommandQueue::push(const Command& cmd) {
+  Node* n = new Node;
+  n->cmd = cmd;
+  pushNode(n);
+}
+
+bool CommandQueue::pop(Command& cmd) {
+  Node* t = tail;
+  Node* next = t->next.load(std::memory_order_acquire);
+
+  if (t == &stub) {
+    if (next == nullptr) return false;
+    tail = next;
+    t = next;
+    next = next->next.load(std::memory_order_acquire);
+  }
+
+  if (next == nullptr) {
+    // t is the last node: put the stub behind it so that it can be removed
+    if (t != head.load(std::memory_order_acquire)) return false;
+    pushNode(&stub);
+    next = t->next.load(std::memory_order_acquire);
+    if (next == nullptr) return false;
+  }
+
+  tail = next;
+  cmd = std::move(t->cmd);
+  delete t;
+  return true;
+}
+
+void SimulationControl::apply(const Command& cmd, std::vector<Flock>& flocks) {
+  switch (cmd.type) {
+    case CommandType::SetParameter: {
+      // the new parameters of every flock are checked before any of them
+      // changes, so that an invalid value leaves all the flocks untouched
+      std::vector<Parameters> pars;
+      for (const Flock& flock : flocks) {
+        if (flock.size() == 0) {
+          pars.emplace_back();
+          continue;
+        }
+        Parameters par = flock.getBoid(0).getPar();
+        switch (cmd.field) {
+          case Field::d: par.d = cmd.value; break;
+          case Field::ds: par.ds = cmd.value; break;
+          case Field::s: par.s = cmd.value; break;
+          case Field::a: par.a = cmd.value; break;
+          case Field::c: par.c = cmd.value; break;
+        }
+        validate(par);
+        pars.push_back(par);
+      }
+      for (int i = 0, n = flocks.size(); i < n; ++i) {
+        if (flocks[i].size() > 0) flocks[i].setParameters(pars[i]);
+      }
+      break;
+    }
+    case CommandType::Spawn: {
+      if (flocks.empty() || flocks.front().size() == 0) {
+        throw std::runtime_error{"Generate a flock before spawning boids."};
+      }
+      Flock& flock = flocks.front();
+      const Boid model = flock.getBoid(0);
+      std::uniform_real_distribution<double> jitter(-5, 5);
+      std::uniform_real_distribution<double> vDist(-1, 1);
+      for (int i = 0; i < cmd.count; ++i) {
+        Boid boid(cmd.x + jitter(eng), cmd.y + jitter(eng));
+        boid.setVelocity({vDist(eng), vDist(eng)});
+        boid.setMaxspeed(model.getMaxspeed());
+        boid.setPar(model.getPar());
+        boid.borders();
+        flock.addBoid(boid);
+      }
+      break;
+    }
+    case CommandType::Pause:
+      paused = true;
+      break;
+    case CommandType::Resume:
+      paused = false;
+      pending_steps = 0;
+      break;
+    case CommandType::Step:
+      pending_steps += cmd.count;
+      break;
+    case CommandType::Snapshot: {
+      std::ofstream out(cmd.path);
+      if (!out) {
+        throw std::runtime_error{"Could not open " + cmd.path + "."};
+      }
+      out << "flock,x,y,vx,vy\n";
+      for (int f = 0, F = flocks.size(); f < F; ++f) {
+        for (const Boid& boid : flocks[f].flock()) {
+          out << f << ',' << boid.getPosition().x << ','
+              << boid.getPosition().y << ',' << boid.getVelocity().x << ','
+              << boid.getVelocity().y << '\n';
+        }
+      }
+      break;
+    }
+  }
+}
+
+void SimulationControl::drain(std::vector<Flock>& flocks) {
+  Command cmd;
+  while (m_queue.pop(cmd)) {
+    // a bad command must not stop a running simulation
+    try {
+      apply(cmd, flocks);
+    } catch (std::exception const& e) {
+      std::cerr << "Control command rejected: " << e.what() << '\n';
+    }
+  }
+}
+
+bool SimulationControl::advance() {
+  if (!paused) return true;
+  if (pending_steps > 0) {
+    --pending_steps;
+    return true;
+  }
+  return false;
+}
+
+ControlEndpoint::ControlEndpoint(CommandQueue& q, const std::string& path)
+    : queue(q), fifo_path(path) {
+  if (mkfifo(path.c_str(), 0600) != 0 && errno != EEXIST) {
+    throw std::runtime_error{"Could not create the control pipe " + path +
+                             ": " + std::strerror(errno)};
+  }
+  // opened for writing too, so that the pipe never reports end of file when
+  // the last writer goes away
+  fd = open(path.c_str(), O_RDWR | O_NONBLOCK);
+  if (fd < 0) {
+    throw std::runtime_error{"Could not open the control pipe " + path + "."};
+  }
+  reader = std::thread(&ControlEndpoint::run, this);
+}
+
+ControlEndpoint::ControlEndpoint(CommandQueue& q, int file_descriptor)
+    : queue(q), fd(file_descriptor) {
+  reader = std::thread(&ControlEndpoint::run, this);
+}
+
+ControlEndpoint::~ControlEndpoint() {
+  stopping = true;
+  reader.join();
+  if (!fifo_path.empty()) {
+    close(fd);
+    unlink(fifo_path.c_str());
+  }
+}
+
+void ControlEndpoint::run() {
+  std::string pending;
+  char buffer[256];
+
+  while (!stopping) {
+    pollfd p{fd, POLLIN, 0};
+    // wakes up regularly to notice the destructor
+    int ready = poll(&p, 1, 100);
+    if (ready <= 0) continue;
+    if (p.revents & (POLLERR | POLLNVAL)) return;
+
+    ssize_t got = read(fd, buffer, sizeof(buffer));
+    if (got == 0) return;  // end of file
+    if (got < 0) {
+      if (errno == EAGAIN || errno == EINTR) continue;
+      return;
+    }
+
+    pending.append(buffer, got);
+    std::size_t end;
+    while ((end = pending.find('\n')) != std::string::npos) {
+      std::string line = pending.substr(0, end);
+      pending.erase(0, end + 1);
+      if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+      try {
+        queue.push(parseCommand(line));
+      } catch (std::exception const& e) {
+        std::cerr << "Bad control command: " << e.what() << '\n';
+      }
+    }
+  }
+}
+
+}  // namespace bd
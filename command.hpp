@@ -0,0 +1,109 @@
+#pragma once
+#ifndef COMMAND_HPP
+#define COMMAND_HPP
+
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "flock.hpp"
+
+namespace bd {
+
+enum class CommandType { SetParameter, Spawn, Pause, Resume, Step, Snapshot };
+
+enum class Field { d, ds, s, a, c };
+
+struct Command {
+  CommandType type{};
+  Field field{};        // SetParameter
+  double value{};       // SetParameter
+  int count{};          // Spawn, Step
+  double x{};           // Spawn
+  double y{};           // Spawn
+  std::string path{};   // Snapshot
+};
+
+// reads a command of the control protocol, one per line:
+//   d|ds|s|a|c VALUE   change a parameter of the running flocks
+//   spawn N X Y        add N boids around (X, Y)
+//   pause | resume     stop or restart the simulation
+//   step [N]           advance N steps (default 1) while paused
+//   snapshot PATH      write the state of the flocks to PATH
+// throws if the line is not a valid command
+Command parseCommand(const std::string& line);
+
+// lock-free queue with many producers and a single consumer (Vyukov's
+// intrusive MPSC queue): push() never blocks, pop() is wait-free for the
+// consumer except while a producer is in the middle of a push.
+class CommandQueue {
+  struct Node {
+    std::atomic<Node*> next{nullptr};
+    Command cmd;
+  };
+
+  std::atomic<Node*> head;
+  Node* tail;
+  Node stub;
+
+  void pushNode(Node* n);
+
+ public:
+  CommandQueue();
+  ~CommandQueue();
+  CommandQueue(const CommandQueue&) = delete;
+  CommandQueue& operator=(const CommandQueue&) = delete;
+
+  // callable from any thread
+  void push(const Command& cmd);
+  // only the simulation thread may pop; false if the queue is empty
+  bool pop(Command& cmd);
+};
+
+// applies the queued commands to the flocks between two steps
+class SimulationControl {
+  CommandQueue m_queue;
+  bool paused{};
+  int pending_steps{};
+  std::default_random_engine eng{};
+
+  void apply(const Command& cmd, std::vector<Flock>& flocks);
+
+ public:
+  CommandQueue& queue() { return m_queue; }
+
+  // drains every pending command, to be called between two steps
+  void drain(std::vector<Flock>& flocks);
+  // true if the flocks have to be updated in this step
+  bool advance();
+
+  bool isPaused() const { return paused; }
+};
+
+// feeds a command queue with the lines read from a file descriptor (a pipe,
+// stdin) or from a named pipe created at a given path, on a background thread
+class ControlEndpoint {
+  CommandQueue& queue;
+  std::string fifo_path;
+  int fd{-1};
+  std::atomic<bool> stopping{false};
+  std::thread reader;
+
+  void run();
+
+ public:
+  // creates the named pipe at path (e.g. "boids.ctl"), write commands with
+  //   echo "s 0.3" > boids.ctl
+  ControlEndpoint(CommandQueue& q, const std::string& path);
+  // reads an already open file descriptor, which is not closed at the end
+  ControlEndpoint(CommandQueue& q, int file_descriptor);
+  ~ControlEndpoint();
+  ControlEndpoint(const ControlEndpoint&) = delete;
+  ControlEndpoint& operator=(const ControlEndpoint&) = delete;
+};
+
+}  // namespace bd
+
+#endif
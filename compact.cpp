@@ -0,0 +1,217 @@
+#include "compact.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace bd {
+
+namespace {
+constexpr double levels{65536.};  // of the position inside a cell
+constexpr double maxLevel{32767.};  // of the velocity fixed point
+
+double largestRadius(const ClassedFlock& flock) {
+  double d = 0.;
+  for (int k = 0; k < flock.classes(); ++k) {
+    d = std::max(d, flock.boidClass(k).par.d);
+  }
+  return std::max(d, 1.);
+}
+}  // namespace
+
+void CompactFlock::Staged::resize(int n) {
+  cell.resize(n);
+  qx.resize(n);
+  qy.resize(n);
+  qvx.resize(n);
+  qvy.resize(n);
+  cls.resize(n);
+  ids.resize(n);
+}
+
+CompactFlock::CompactFlock(const ClassedFlock& flock)
+    : grid(largestRadius(flock)) {
+  cell_w = worldWidth / grid.columns();
+  cell_h = worldHeight / grid.rows();
+
+  const int N = flock.size();
+  double vmax = 0.;
+  for (int k = 0; k < flock.classes(); ++k) {
+    table.push_back(flock.boidClass(k));
+    vmax = std::max(vmax, table.back().maxspeed);
+  }
+  // velocities set above the speed limit must fit as well
+  for (int i = 0; i < N; ++i) {
+    vmax = std::max({vmax, std::abs(flock.velocity(i).x),
+                     std::abs(flock.velocity(i).y)});
+  }
+  if (!std::isfinite(vmax)) {
+    throw std::runtime_error{
+        "Something went wrong. A compact flock needs a finite maxspeed.\n"};
+  }
+  vscale = vmax > 0. ? vmax / maxLevel : 1.;
+
+  Staged staged;
+  staged.resize(N);
+  for (int i = 0; i < N; ++i) {
+    encodePosition(flock.position(i), staged.cell[i], staged.qx[i],
+                   staged.qy[i]);
+    staged.qvx[i] = encodeSpeed(flock.velocity(i).x);
+    staged.qvy[i] = encodeSpeed(flock.velocity(i).y);
+    staged.cls[i] = flock.classOf(i);
+    staged.ids[i] = i;
+  }
+  store(staged);
+}
+
+std::size_t CompactFlock::bytes() const {
+  const std::size_t per_boid = sizeof(std::uint16_t) * 2 +
+                               sizeof(std::int16_t) * 2 +
+                               sizeof(std::uint8_t) + sizeof(std::uint32_t);
+  return per_boid * size() + sizeof(int) * cell_start.size();
+}
+
+double CompactFlock::positionError() const {
+  return std::max(cell_w, cell_h) / (2 * levels);
+}
+
+// the centre of the quantization step, so the error is at most half a step
+sf::Vector2<double> CompactFlock::decodePosition(int cell, int i) const {
+  const int cx = cell % grid.columns();
+  const int cy = cell / grid.columns();
+  return {(cx + (qx[i] + 0.5) / levels) * cell_w,
+          (cy + (qy[i] + 0.5) / levels) * cell_h};
+}
+
+sf::Vector2<double> CompactFlock::decodeVelocity(int i) const {
+  return {qvx[i] * vscale, qvy[i] * vscale};
+}
+
+void CompactFlock::encodePosition(const sf::Vector2<double>& p, int& cell,
+                                  std::uint16_t& x, std::uint16_t& y) const {
+  const sf::Vector2<double> w = wrapPosition(p);
+  cell = grid.cellOf(w);
+  const int cx = cell % grid.columns();
+  const int cy = cell / grid.columns();
+  const double fx = (w.x / cell_w - cx) * levels;
+  const double fy = (w.y / cell_h - cy) * levels;
+  x = static_cast<std::uint16_t>(std::clamp(std::floor(fx), 0., levels - 1));
+  y = static_cast<std::uint16_t>(std::clamp(std::floor(fy), 0., levels - 1));
+}
+
+std::int16_t CompactFlock::encodeSpeed(double v) const {
+  return static_cast<std::int16_t>(
+      std::clamp(std::round(v / vscale), -maxLevel, maxLevel));
+}
+
+void CompactFlock::store(const Staged& s) {
+  const int N = s.cell.size();
+  const int C = grid.cells();
+  cell_start.assign(C + 1, 0);
+  for (int i = 0; i < N; ++i) {
+    ++cell_start[s.cell[i] + 1];
+  }
+  for (int c = 0; c < C; ++c) {
+    cell_start[c + 1] += cell_start[c];
+  }
+  qx.resize(N);
+  qy.resize(N);
+  qvx.resize(N);
+  qvy.resize(N);
+  cls.resize(N);
+  ids.resize(N);
+  std::vector<int> fill(cell_start.begin(), cell_start.end() - 1);
+  for (int i = 0; i < N; ++i) {
+    const int k = fill[s.cell[i]]++;
+    qx[k] = s.qx[i];
+    qy[k] = s.qy[i];
+    qvx[k] = s.qvx[i];
+    qvy[k] = s.qvy[i];
+    cls[k] = s.cls[i];
+    ids[k] = s.ids[i];
+  }
+}
+
+ClassedFlock CompactFlock::toClassed() const {
+  const int N = size();
+  std::vector<int> where(N);
+  std::vector<int> cell_of(N);
+  for (int c = 0; c < grid.cells(); ++c) {
+    for (int k = cell_start[c]; k < cell_start[c + 1]; ++k) {
+      where[ids[k]] = k;
+      cell_of[ids[k]] = c;
+    }
+  }
+  ClassedFlock flock;
+  for (const BoidClass& c : table) {
+    flock.addClass(c);
+  }
+  for (int id = 0; id < N; ++id) {
+    const int k = where[id];
+    flock.addBoid(decodePosition(cell_of[id], k), decodeVelocity(k), cls[k]);
+  }
+  return flock;
+}
+
+void CompactFlock::updateFlock(double const delta_t) {
+  const int N = size();
+  const int C = grid.cells();
+  Staged next;
+  next.resize(N);
+
+  auto work = [&](int begin, int end) {
+    // the 3x3 block around a cell, decoded
+    std::vector<double> x, y, vx, vy;
+    int around[9];
+    for (int c = begin; c < end; ++c) {
+      if (cell_start[c] == cell_start[c + 1]) continue;
+      x.clear();
+      y.clear();
+      vx.clear();
+      vy.clear();
+      for (int k = 0, n = grid.neighbourCells(c, around); k < n; ++k) {
+        for (int j = cell_start[around[k]]; j < cell_start[around[k] + 1];
+             ++j) {
+          const sf::Vector2<double> p = decodePosition(around[k], j);
+          const sf::Vector2<double> v = decodeVelocity(j);
+          x.push_back(p.x);
+          y.push_back(p.y);
+          vx.push_back(v.x);
+          vy.push_back(v.y);
+        }
+      }
+
+      for (int i = cell_start[c]; i < cell_start[c + 1]; ++i) {
+        const sf::Vector2<double> p = decodePosition(c, i);
+        const sf::Vector2<double> v = decodeVelocity(i);
+        BoidState st{p.x, p.y, v.x, v.y};
+        updateState(st, table[cls[i]], x.data(), y.data(), vx.data(),
+                    vy.data(), x.size(), delta_t);
+        encodePosition({st.x, st.y}, next.cell[i], next.qx[i], next.qy[i]);
+        next.qvx[i] = encodeSpeed(st.vx);
+        next.qvy[i] = encodeSpeed(st.vy);
+        next.cls[i] = cls[i];
+        next.ids[i] = ids[i];
+      }
+    }
+  };
+
+  if (scheduler) {
+    std::vector<double> weights(C);
+    int around[9];
+    for (int c = 0; c < C; ++c) {
+      int neighbours = 0;
+      for (int k = 0, n = grid.neighbourCells(c, around); k < n; ++k) {
+        neighbours += cell_start[around[k] + 1] - cell_start[around[k]];
+      }
+      weights[c] =
+          static_cast<double>(cell_start[c + 1] - cell_start[c]) * neighbours;
+    }
+    scheduler->run(weights, work);
+  } else {
+    work(0, C);
+  }
+  store(next);
+}
+
+}  // namespace bd
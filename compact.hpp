@@ -0,0 +1,95 @@
+#pragma once
+#ifndef COMPACT_HPP
+#define COMPACT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "classed.hpp"
+#include "grid.hpp"
+#include "scheduler.hpp"
+
+namespace bd {
+
+// Flock state squeezed for worlds of millions of boids: 13 bytes per boid
+// instead of the 80 of a Boid.
+//   position: 16 bits per coordinate, relative to the grid cell holding the
+//             boid (cells are at least the largest d wide)
+//   velocity: 16-bit fixed point per component, scaled to the largest speed
+//   class:    one byte into the table of a ClassedFlock
+//   id:       32 bits, the index of the boid in the flock it came from
+// Boids are stored sorted by cell. Every step decodes the 3x3 block of cells
+// around each cell, applies the rules of Boid::update in double precision to
+// the boids of the cell, and stores the results quantized again.
+//
+// Errors: decoded positions are within positionError() (half a step of the
+// 16-bit grid, 1/131072 of a cell) of the computed ones on each coordinate,
+// velocities within velocityError() (half a step of the fixed point). They
+// enter the next step as a perturbation of that size, so trajectories stay
+// close to the full precision ones for as long as the dynamics is not
+// chaotic. The update is a Jacobi one: every boid sees the others as they
+// were at the start of the step, as with Flock::setScheduler.
+class CompactFlock {
+  SpatialGrid grid;  // only its geometry, the boids are sorted here
+  double cell_w{};
+  double cell_h{};
+  double vscale{};  // speed of one unit of the fixed point
+  std::vector<BoidClass> table;
+
+  std::vector<int> cell_start;
+  std::vector<std::uint16_t> qx, qy;
+  std::vector<std::int16_t> qvx, qvy;
+  std::vector<std::uint8_t> cls;
+  std::vector<std::uint32_t> ids;
+
+  std::shared_ptr<AdaptiveScheduler> scheduler;
+
+  // encoded boids in any order, with their cells
+  struct Staged {
+    std::vector<int> cell;
+    std::vector<std::uint16_t> qx, qy;
+    std::vector<std::int16_t> qvx, qvy;
+    std::vector<std::uint8_t> cls;
+    std::vector<std::uint32_t> ids;
+
+    void resize(int n);
+  };
+  // counting sort of the staged boids by cell into the state
+  void store(const Staged& s);
+
+  sf::Vector2<double> decodePosition(int cell, int i) const;
+  sf::Vector2<double> decodeVelocity(int i) const;
+  // cell and quantized offsets of a position inside the world
+  void encodePosition(const sf::Vector2<double>& p, int& cell,
+                      std::uint16_t& x, std::uint16_t& y) const;
+  std::int16_t encodeSpeed(double v) const;
+
+ public:
+  explicit CompactFlock(const ClassedFlock& flock);
+  explicit CompactFlock(const Flock& flock)
+      : CompactFlock(ClassedFlock::fromFlock(flock)) {}
+
+  int size() const { return ids.size(); }
+  // memory of the per-boid state and of the cell offsets
+  std::size_t bytes() const;
+
+  double positionError() const;
+  double velocityError() const { return vscale / 2; }
+
+  // back to full precision, in the original order of the boids
+  ClassedFlock toClassed() const;
+  Flock toFlock() const { return toClassed().toFlock(); }
+
+  // cells updated in parallel (nullptr: one thread)
+  void setScheduler(std::shared_ptr<AdaptiveScheduler> s) {
+    scheduler = std::move(s);
+  }
+
+  void updateFlock(double const delta_t);
+};
+
+}  // namespace bd
+
+#endif
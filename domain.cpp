@@ -0,0 +1,232 @@
+#include "domain.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+
+#include "grid.hpp"
+
+namespace bd {
+
+bool Tile::contains(const sf::Vector2<double>& p) const {
+  return p.x >= x0 && p.x < x1 && p.y >= y0 && p.y < y1;
+}
+
+double Tile::distance(const sf::Vector2<double>& p) const {
+  double gx = periodicGap(p.x, x0, x1, worldWidth);
+  double gy = periodicGap(p.y, y0, y1, worldHeight);
+  return std::sqrt(gx * gx + gy * gy);
+}
+
+Decomposition::Decomposition(int columns, int rows)
+    : m_columns(columns), m_rows(rows) {
+  if (columns < 1 || rows < 1) {
+    throw std::runtime_error{
+        "Something went wrong. The world needs at least one tile.\n"};
+  }
+}
+
+Tile Decomposition::tile(int rank) const {
+  assert(rank >= 0 && rank < size());
+  double w = worldWidth / m_columns;
+  double h = worldHeight / m_rows;
+  int cx = rank % m_columns;
+  int cy = rank / m_columns;
+  return {cx * w, cy * h, (cx + 1) * w, (cy + 1) * h};
+}
+
+int Decomposition::owner(const sf::Vector2<double>& p) const {
+  int cx = static_cast<int>(p.x / (worldWidth / m_columns));
+  int cy = static_cast<int>(p.y / (worldHeight / m_rows));
+  // boids sitting exactly on the far border belong to the last tile
+  cx = std::clamp(cx, 0, m_columns - 1);
+  cy = std::clamp(cy, 0, m_rows - 1);
+  return cy * m_columns + cx;
+}
+
+TileFlock::TileFlock(const Decomposition& dec, Transport& t, double halo_width)
+    : decomposition(dec), transport(t), halo(halo_width) {
+  if (dec.size() != t.size()) {
+    throw std::runtime_error{
+        "Something went wrong. The transport must have one rank per tile.\n"};
+  }
+  if (halo_width < 0.) {
+    throw std::runtime_error{
+        "Something went wrong. The halo width must be positive.\n"};
+  }
+}
+
+void TileFlock::scatter(const Flock& flock) {
+  owned.clear();
+  for (const Boid& boid : flock.flock()) {
+    addBoid(boid);
+  }
+}
+
+void TileFlock::addBoid(const Boid& b) {
+  if (decomposition.owner(b.getPosition()) == transport.rank()) {
+    owned.push_back(b);
+  }
+}
+
+void TileFlock::step(double const delta_t) {
+  const int n = transport.size();
+  const int me = transport.rank();
+
+  // ghost halo: every boid closer than halo to another tile is sent to it
+  std::vector<Message> outgoing(n);
+  for (int r = 0; r < n; ++r) {
+    if (r == me) continue;
+    Tile t = decomposition.tile(r);
+    for (const Boid& boid : owned) {
+      if (t.distance(boid.getPosition()) < halo) {
+        boid.pack(outgoing[r]);
+      }
+    }
+  }
+  std::vector<Message> incoming = transport.exchange(outgoing);
+
+  // ghosts are appended after the owned boids, so that with a single tile the
+  // update is exactly the one of Flock::updateFlock
+  std::vector<Boid> local = owned;
+  ghosts = 0;
+  for (const Message& m : incoming) {
+    for (int k = 0, K = m.size(); k + Boid::packedSize <= K;
+         k += Boid::packedSize) {
+      local.push_back(Boid::unpack(m.data() + k));
+      ++ghosts;
+    }
+  }
+
+  for (int i = 0, N = owned.size(); i < N; ++i) {
+    local[i].update(local, delta_t);
+  }
+  owned.assign(local.begin(), local.begin() + owned.size());
+
+  migrate();
+}
+
+void TileFlock::migrate() {
+  const int n = transport.size();
+  const int me = transport.rank();
+
+  std::vector<Message> outgoing(n);
+  std::vector<Boid> staying;
+  for (const Boid& boid : owned) {
+    int r = decomposition.owner(boid.getPosition());
+    if (r == me) {
+      staying.push_back(boid);
+    } else {
+      boid.pack(outgoing[r]);
+    }
+  }
+  owned.swap(staying);
+
+  for (const Message& m : transport.exchange(outgoing)) {
+    for (int k = 0, K = m.size(); k + Boid::packedSize <= K;
+         k += Boid::packedSize) {
+      owned.push_back(Boid::unpack(m.data() + k));
+    }
+  }
+}
+
+int TileFlock::size() {
+  Message total = transport.allreduce({static_cast<double>(owned.size())});
+  return static_cast<int>(total[0]);
+}
+
+Flock TileFlock::gather() {
+  Message mine;
+  for (const Boid& boid : owned) {
+    boid.pack(mine);
+  }
+  Flock flock;
+  for (const Message& m : transport.allgather(mine)) {
+    for (int k = 0, K = m.size(); k + Boid::packedSize <= K;
+         k += Boid::packedSize) {
+      flock.addBoid(Boid::unpack(m.data() + k));
+    }
+  }
+  return flock;
+}
+
+// pairs are counted as in Flock::average_distance on the flock obtained by
+// concatenating the tiles in rank order: the pairs inside a tile plus the
+// pairs with the boids of the tiles of higher rank.
+Statistics TileFlock::average_distance() {
+  const int me = transport.rank();
+
+  Message mine;
+  for (const Boid& boid : owned) {
+    mine.push_back(boid.getPosition().x);
+    mine.push_back(boid.getPosition().y);
+  }
+  std::vector<Message> positions = transport.allgather(mine);
+
+  double sum_d = 0.0;
+  double sum_d2 = 0.0;
+  double pair_count = 0.0;
+  auto addPair = [&](const sf::Vector2<double>& p1,
+                     const sf::Vector2<double>& p2) {
+    double distance1 = bd::distance(p1, p2);
+    assert(distance1 >= 0.);
+    sum_d += distance1;
+    sum_d2 += distance1 * distance1;
+    pair_count += 1.;
+  };
+
+  for (int i = 0, N = owned.size(); i < N; ++i) {
+    const sf::Vector2<double> pos1 = owned[i].getPosition();
+    for (int j = i + 1; j < N; ++j) {
+      addPair(pos1, owned[j].getPosition());
+    }
+    for (int r = me + 1, R = positions.size(); r < R; ++r) {
+      for (int k = 0, K = positions[r].size(); k + 1 < K; k += 2) {
+        addPair(pos1, {positions[r][k], positions[r][k + 1]});
+      }
+    }
+  }
+
+  Message total = transport.allreduce({pair_count, sum_d, sum_d2});
+  pair_count = total[0];
+
+  if (pair_count < 2) {
+    throw std::runtime_error{"Not enough entries to run a statistics."};
+  }
+
+  double average_distance = total[1] / pair_count;
+  assert(average_distance >= 0.);
+  const double sigma_d =
+      std::sqrt((total[2] - pair_count * average_distance * average_distance) /
+                (pair_count - 1));
+
+  return {average_distance, sigma_d};
+}
+
+Statistics TileFlock::average_speed() {
+  double sum_v = 0.0;
+  double sum_v2 = 0.0;
+  for (const Boid& boid : owned) {
+    double speed1 = bd::magnitude(boid.getVelocity());
+    sum_v += speed1;
+    sum_v2 += speed1 * speed1;
+  }
+
+  Message total = transport.allreduce(
+      {static_cast<double>(owned.size()), sum_v, sum_v2});
+  double N = total[0];
+
+  if (N < 2) {
+    throw std::runtime_error{"Not enough entries to run a statistics."};
+  }
+
+  double average_speed = total[1] / N;
+  assert(average_speed >= 0.0);
+  const double sigma_v =
+      std::sqrt((total[2] - N * average_speed * average_speed) / (N - 1));
+
+  return {average_speed, sigma_v};
+}
+
+}  // namespace bd
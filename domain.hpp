@@ -0,0 +1,76 @@
+#pragma once
+#ifndef DOMAIN_HPP
+#define DOMAIN_HPP
+
+#include "boid.hpp"
+#include "flock.hpp"
+#include "transport.hpp"
+
+namespace bd {
+
+// rectangular region [x0, x1) x [y0, y1) of the toroidal world
+struct Tile {
+  double x0{};
+  double y0{};
+  double x1{};
+  double y1{};
+
+  bool contains(const sf::Vector2<double>& p) const;
+  // shortest (periodic) distance between a point and the tile
+  double distance(const sf::Vector2<double>& p) const;
+};
+
+// splits the world in columns x rows tiles, rank r owns tile
+// (r % columns, r / columns)
+class Decomposition {
+  int m_columns{};
+  int m_rows{};
+
+ public:
+  Decomposition(int columns, int rows);
+
+  int size() const { return m_columns * m_rows; }
+  Tile tile(int rank) const;
+  // rank of the tile that owns a point of the world
+  int owner(const sf::Vector2<double>& p) const;
+};
+
+// the part of a flock owned by a single rank. Every step the boids closer
+// than Parameters::d to the tile are received as read-only ghosts from the
+// neighbouring tiles, then the owned boids are updated and those that left
+// the tile are migrated to their new owner.
+// step(), size() and the statistics are collective calls: every rank of the
+// transport must call them in the same order.
+class TileFlock {
+  Decomposition decomposition;
+  Transport& transport;
+  std::vector<Boid> owned;
+  double halo{};
+  int ghosts{};
+
+  void migrate();
+
+ public:
+  TileFlock(const Decomposition& dec, Transport& t, double halo_width);
+
+  // keeps only the boids of the flock that belong to this tile
+  void scatter(const Flock& flock);
+  void addBoid(const Boid& b);
+
+  const std::vector<Boid>& ownedBoids() const { return owned; }
+  int ghostCount() const { return ghosts; }
+
+  void step(double const delta_t);
+
+  // total number of boids over all the tiles
+  int size();
+  // every rank gets the whole flock, ordered by rank
+  Flock gather();
+
+  Statistics average_distance();
+  Statistics average_speed();
+};
+
+}  // namespace bd
+
+#endif
@@ -0,0 +1,135 @@
+#include "ensemble.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+#include "scheduler.hpp"
+
+namespace bd {
+
+Flock randomFlock(int N, const Parameters& par, double maxspeed,
+                  unsigned seed) {
+  std::default_random_engine eng(seed);
+  std::uniform_real_distribution<double> xDist(0, worldWidth);
+  std::uniform_real_distribution<double> yDist(0, worldHeight);
+  std::uniform_real_distribution<double> vxDist(-1, 1);
+  std::uniform_real_distribution<double> vyDist(-1, 1);
+
+  Flock flock;
+  for (int i = 0; i < N; i++) {
+    double posX = xDist(eng);
+    double posY = yDist(eng);
+    double velX = vxDist(eng);
+    double velY = vyDist(eng);
+
+    Boid newBoid(posX, posY);
+    newBoid.setMaxspeed(maxspeed);
+    newBoid.setVelocity({velX, velY});
+
+    flock.addBoid(newBoid);
+  }
+  flock.setParameters(par);
+  return flock;
+}
+
+std::vector<EnsembleRun> parameterGrid(const std::vector<Parameters>& pars,
+                                       const std::vector<unsigned>& seeds,
+                                       int boids, double maxspeed) {
+  std::vector<EnsembleRun> runs;
+  for (const Parameters& par : pars) {
+    for (unsigned seed : seeds) {
+      runs.push_back({par, seed, boids, maxspeed});
+    }
+  }
+  return runs;
+}
+
+namespace {
+
+// the time series of a single run, before being merged into the columns
+struct Series {
+  std::vector<double> time;
+  std::vector<Statistics> distance;
+  std::vector<Statistics> speed;
+};
+
+Series simulate(const EnsembleRun& r, double duration, double delta_t) {
+  Flock flock = randomFlock(r.boids, r.par, r.maxspeed, r.seed);
+  Series series;
+  double time{};
+  while (time < duration) {
+    series.time.push_back(time);
+    series.distance.push_back(flock.average_distance());
+    series.speed.push_back(flock.average_speed());
+    flock.updateFlock(delta_t);
+    time += delta_t;
+  }
+  return series;
+}
+
+}  // namespace
+
+EnsembleResult runEnsemble(const std::vector<EnsembleRun>& runs,
+                           double duration, double delta_t, int threads) {
+  if (delta_t <= 0.) {
+    throw std::runtime_error{
+        "Something went wrong. delta_t must be positive.\n"};
+  }
+  for (const EnsembleRun& r : runs) {
+    if (r.boids < 2) {
+      throw std::runtime_error{
+          "Not enough data. Every run needs at least two boids.\n"};
+    }
+  }
+
+  if (threads <= 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  const int R = runs.size();
+  threads = std::max(1, std::min(threads, R));
+
+  StealingDeques work(threads);
+  for (int i = 0; i < R; ++i) {
+    work.push(i % threads, i);
+  }
+
+  std::vector<Series> series(R);
+  std::vector<std::exception_ptr> errors(threads);
+  std::vector<std::thread> workers;
+  for (int w = 0; w < threads; ++w) {
+    workers.emplace_back([&, w] {
+      try {
+        int i;
+        while (work.next(w, i)) {
+          series[i] = simulate(runs[i], duration, delta_t);
+        }
+      } catch (...) {
+        errors[w] = std::current_exception();
+      }
+    });
+  }
+  for (auto& t : workers) t.join();
+  for (auto& e : errors) {
+    if (e) std::rethrow_exception(e);
+  }
+
+  EnsembleResult result;
+  for (int i = 0; i < R; ++i) {
+    const Series& s = series[i];
+    for (int k = 0, K = s.time.size(); k < K; ++k) {
+      result.run.push_back(i);
+      result.step.push_back(k);
+      result.time.push_back(s.time[k]);
+      result.distance_mean.push_back(s.distance[k].mean);
+      result.distance_sigma.push_back(s.distance[k].sigma);
+      result.speed_mean.push_back(s.speed[k].mean);
+      result.speed_sigma.push_back(s.speed[k].sigma);
+    }
+  }
+  return result;
+}
+
+}  // namespace bd
@@ -0,0 +1,52 @@
+#pragma once
+#ifndef ENSEMBLE_HPP
+#define ENSEMBLE_HPP
+
+#include <vector>
+
+#include "flock.hpp"
+
+namespace bd {
+
+// one independent simulation of a parameter study
+struct EnsembleRun {
+  Parameters par{};
+  unsigned seed{};
+  int boids{};
+  double maxspeed{500};
+};
+
+// per-step statistics of every run, one column per quantity: row i belongs to
+// run[i] at step[i]. Rows are sorted by run and step, whatever the order in
+// which the runs were computed.
+struct EnsembleResult {
+  std::vector<int> run;
+  std::vector<int> step;
+  std::vector<double> time;
+  std::vector<double> distance_mean;
+  std::vector<double> distance_sigma;
+  std::vector<double> speed_mean;
+  std::vector<double> speed_sigma;
+
+  int rows() const { return run.size(); }
+};
+
+// flock with uniformly distributed positions and velocities in [-1, 1], as
+// generated by main.cpp, but reproducible from the seed
+Flock randomFlock(int N, const Parameters& par, double maxspeed,
+                  unsigned seed);
+
+// every combination of parameters and seeds
+std::vector<EnsembleRun> parameterGrid(const std::vector<Parameters>& pars,
+                                       const std::vector<unsigned>& seeds,
+                                       int boids, double maxspeed);
+
+// runs every flock for duration with the step loop of main.cpp. The runs are
+// spread over threads workers (0: one per core) that steal runs from each
+// other when they run out of work.
+EnsembleResult runEnsemble(const std::vector<EnsembleRun>& runs,
+                           double duration, double delta_t, int threads = 0);
+
+}  // namespace bd
+
+#endif
@@ -0,0 +1,92 @@
+#include "fastmath.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace bd {
+
+void magnitudes(const double* x, const double* y, double* out, int n,
+                MathMode mode) {
+  if (mode == MathMode::Exact) {
+    for (int i = 0; i < n; ++i) {
+      out[i] = std::sqrt(x[i] * x[i] + y[i] * y[i]);
+    }
+  } else {
+    for (int i = 0; i < n; ++i) {
+      const double s = x[i] * x[i] + y[i] * y[i];
+      out[i] = s * fastRsqrt(s);
+    }
+  }
+}
+
+void angles(const double* x, const double* y, double* out, int n,
+            MathMode mode) {
+  if (mode == MathMode::Exact) {
+    for (int i = 0; i < n; ++i) {
+      out[i] = std::atan2(y[i], x[i]);
+    }
+  } else {
+    for (int i = 0; i < n; ++i) {
+      out[i] = fastAtan2(y[i], x[i]);
+    }
+  }
+}
+
+void clampSpeeds(double* vx, double* vy, int n, double maxspeed,
+                 MathMode mode) {
+  if (mode == MathMode::Exact) {
+    for (int i = 0; i < n; ++i) {
+      clampSpeed(vx[i], vy[i], maxspeed, MathMode::Exact);
+    }
+  } else {
+    // the factors first, then the products: in a single loop the compiler
+    // skips the store of a product by 1, and a conditional store is not
+    // vectorized
+    constexpr int B = 64;
+    double scale[B];
+    for (int begin = 0; begin < n; begin += B) {
+      const int m = std::min(B, n - begin);
+      double* x = vx + begin;
+      double* y = vy + begin;
+      for (int i = 0; i < m; ++i) {
+        scale[i] = fastSpeedScale(x[i], y[i], maxspeed);
+      }
+      for (int i = 0; i < m; ++i) {
+        x[i] *= scale[i];
+        y[i] *= scale[i];
+      }
+    }
+  }
+}
+
+// gathers the velocity components in two arrays and runs the batch kernel
+static void velocityArrays(const std::vector<Boid>& boids,
+                           std::vector<double>& vx, std::vector<double>& vy) {
+  vx.resize(boids.size());
+  vy.resize(boids.size());
+  for (int i = 0, N = boids.size(); i < N; ++i) {
+    const sf::Vector2<double> v = boids[i].getVelocity();
+    vx[i] = v.x;
+    vy[i] = v.y;
+  }
+}
+
+void speeds(const std::vector<Boid>& boids, std::vector<double>& out,
+            MathMode mode) {
+  std::vector<double> vx;
+  std::vector<double> vy;
+  velocityArrays(boids, vx, vy);
+  out.resize(boids.size());
+  magnitudes(vx.data(), vy.data(), out.data(), out.size(), mode);
+}
+
+void headings(const std::vector<Boid>& boids, std::vector<double>& out,
+              MathMode mode) {
+  std::vector<double> vx;
+  std::vector<double> vy;
+  velocityArrays(boids, vx, vy);
+  out.resize(boids.size());
+  angles(vx.data(), vy.data(), out.data(), out.size(), mode);
+}
+
+}  // namespace bd
@@ -0,0 +1,105 @@
+#pragma once
+#ifndef FASTMATH_HPP
+#define FASTMATH_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "boid.hpp"
+
+namespace bd {
+
+// Exact: same results, bit for bit, as magnitude(), angle() and the speed
+//        limit of Boid::limitSpeed.
+// Fast:  reciprocal square root from a bit trick refined with three Newton
+//        steps (relative error below 1e-10, also for the clamped speeds)
+//        and a polynomial arctangent (absolute error below 2e-8 rad).
+enum class MathMode { Exact, Fast };
+
+inline double fastRsqrt(double x) {
+  std::uint64_t i;
+  std::memcpy(&i, &x, sizeof(i));
+  i = 0x5fe6eb50c7b537a9ULL - (i >> 1);
+  double r;
+  std::memcpy(&r, &i, sizeof(r));
+  // each Newton step roughly squares the relative error of the guess
+  r = r * (1.5 - 0.5 * x * r * r);
+  r = r * (1.5 - 0.5 * x * r * r);
+  r = r * (1.5 - 0.5 * x * r * r);
+  return r;
+}
+
+// arctangent on [0, 1] from Abramowitz and Stegun 4.4.49, error below 2e-8
+inline double atanUnit(double t) {
+  const double t2 = t * t;
+  double p = 0.0028662257;
+  p = p * t2 - 0.0161657367;
+  p = p * t2 + 0.0429096138;
+  p = p * t2 - 0.0752896400;
+  p = p * t2 + 0.1065626393;
+  p = p * t2 - 0.1420889944;
+  p = p * t2 + 0.1999355085;
+  p = p * t2 - 0.3333314528;
+  return t + t * t2 * p;
+}
+
+// no branch and no division by zero, so that a loop of calls is vectorized
+inline double fastAtan2(double y, double x) {
+  const double ax = std::fabs(x);
+  const double ay = std::fabs(y);
+  const double mx = ax > ay ? ax : ay;
+  const double mn = ax > ay ? ay : ax;
+  const double r = atanUnit(mn / (mx > 1e-300 ? mx : 1e-300));
+  // the reflections as products instead of selects, which would keep
+  // their subtractions behind a branch
+  const double swap = ay > ax;
+  const double left = x < 0.;
+  const double q = swap * M_PI_2 + (1. - 2. * swap) * r;
+  return std::copysign(left * M_PI + (1. - 2. * left) * q, y);
+}
+
+// factor bringing (vx, vy) down to maxspeed: maxspeed / |v| capped at 1,
+// also for a null velocity, where the reciprocal square root is large but
+// finite
+inline double fastSpeedScale(double vx, double vy, double maxspeed) {
+  const double k = maxspeed * fastRsqrt(vx * vx + vy * vy);
+  return k < 1. ? k : 1.;
+}
+
+// rescales (vx, vy) to maxspeed if it is faster; a null velocity is left
+// alone
+inline void clampSpeed(double& vx, double& vy, double maxspeed,
+                       MathMode mode) {
+  if (mode == MathMode::Exact) {
+    const double mag = std::sqrt(vx * vx + vy * vy);
+    if (mag > maxspeed) {
+      vx = (vx / mag) * maxspeed;
+      vy = (vy / mag) * maxspeed;
+    }
+  } else {
+    const double scale = fastSpeedScale(vx, vy, maxspeed);
+    vx *= scale;
+    vy *= scale;
+  }
+}
+
+// The Fast loops are branch-free over plain arrays and the compiler turns
+// them into SIMD code; the Exact ones call the library functions.
+void magnitudes(const double* x, const double* y, double* out, int n,
+                MathMode mode);
+void angles(const double* x, const double* y, double* out, int n,
+            MathMode mode);
+void clampSpeeds(double* vx, double* vy, int n, double maxspeed,
+                 MathMode mode);
+
+// batch versions working on the boids of a flock
+void speeds(const std::vector<Boid>& boids, std::vector<double>& out,
+            MathMode mode);
+void headings(const std::vector<Boid>& boids, std::vector<double>& out,
+              MathMode mode);
+
+}  // namespace bd
+
+#endif
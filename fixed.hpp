@@ -0,0 +1,175 @@
+#pragma once
+#ifndef FIXED_HPP
+#define FIXED_HPP
+
+#include <stdexcept>
+#include <vector>
+
+#include "boid.hpp"
+#include "classed.hpp"
+#include "flock.hpp"
+
+namespace bd {
+
+// Compile-time parameters are a struct with the static constexpr members
+// d, ds, s, a, c and maxspeed, e.g. the configuration suggested in the
+// README:
+struct StandardParameters {
+  static constexpr double d{300};
+  static constexpr double ds{50};
+  static constexpr double s{0.5};
+  static constexpr double a{0.5};
+  static constexpr double c{0.5};
+  static constexpr double maxspeed{400};
+};
+
+// The kernel of updateStateWith with the parameters as constants: the
+// radii are compared squared, which the compiler folds, and the sums are
+// kept in lanes of independent partial sums, which it turns into vector
+// instructions, and the speed limit takes the Fast clamp of fastmath.hpp.
+// All of them change the rounding only, so the result matches
+// updateStateWith up to the last bits.
+template <class P>
+inline void updateStateFixed(BoidState& st, const double* x, const double* y,
+                             const double* vx, const double* vy, int n,
+                             double const delta_t) {
+  constexpr int L = 8;
+  constexpr double d2 = P::d * P::d;
+  constexpr double ds2 = P::ds * P::ds;
+  const double half_w = worldWidth / 2;
+  const double half_h = worldHeight / 2;
+  const double xi = st.x;
+  const double yi = st.y;
+  const double vxi = st.vx;
+  const double vyi = st.vy;
+
+  double sep_x[L]{}, sep_y[L]{};
+  double ali_x[L]{}, ali_y[L]{};
+  double coh_x[L]{}, coh_y[L]{};
+  double n_ali[L]{}, n_coh[L]{};
+  auto add = [&](int l, int j) {
+    const double dx = x[j] - xi;
+    const double dy = y[j] - yi;
+    const double wx = dx > half_w ? worldWidth - dx : dx;
+    const double wy = dy > half_h ? worldHeight - dy : dy;
+    const double q = wx * wx + wy * wy;
+    const double e = dx * dx + dy * dy;
+    const double near = q < d2 ? 1. : 0.;
+    const double close = q < ds2 ? 1. : 0.;
+    const double e_near = e < d2 ? 1. : 0.;
+    sep_x[l] += close * dx;
+    sep_y[l] += close * dy;
+    ali_x[l] += near * (vx[j] - vxi);
+    ali_y[l] += near * (vy[j] - vyi);
+    n_ali[l] += near;
+    coh_x[l] += e_near * x[j];
+    coh_y[l] += e_near * y[j];
+    n_coh[l] += e_near;
+  };
+  int j = 0;
+  for (; j + L <= n; j += L) {
+    for (int l = 0; l < L; ++l) add(l, j + l);
+  }
+  for (int l = 0; j < n; ++j, ++l) add(l, j);
+
+  RuleSums r;
+  double na{}, nc{};
+  for (int l = 0; l < L; ++l) {
+    r.sep_x += sep_x[l];
+    r.sep_y += sep_y[l];
+    r.ali_x += ali_x[l];
+    r.ali_y += ali_y[l];
+    r.coh_x += coh_x[l];
+    r.coh_y += coh_y[l];
+    na += n_ali[l];
+    nc += n_coh[l];
+  }
+  r.n_ali = static_cast<int>(na);
+  r.n_coh = static_cast<int>(nc);
+  applyRules(st, P{}, r, delta_t, MathMode::Fast);
+}
+
+// A flock whose parameters are fixed when it is compiled: the rule weights
+// and radii are constants of the kernel, and the ranges of validate() are
+// checked by the compiler instead of at run time. Updated in the order of
+// Flock::updateFlock with updateStateFixed, so the trajectories follow
+// those of Flock up to rounding. It is a class of its own, not a
+// specialization of Flock: it has only the metric rules over all the
+// boids, without substeps, environment, perception, scheduler or
+// publisher; fromFlock and toFlock convert between the two. Flock and
+// ClassedFlock stay the choice when the parameters change at run time or
+// those features are needed.
+template <class P>
+class FixedFlock {
+  static_assert(P::d >= 0., "Parameter d must be positive.");
+  static_assert(P::ds >= 0. && P::ds < P::d,
+                "Parameter ds must be positive and smaller than d.");
+  static_assert(P::s >= 0. && P::s <= 1., "Parameter s must be in [0, 1].");
+  static_assert(P::a >= 0. && P::a <= 1., "Parameter a must be in [0, 1].");
+  static_assert(P::c >= 0. && P::c <= 1., "Parameter c must be in [0, 1].");
+
+  std::vector<double> x, y, vx, vy;
+
+ public:
+  static constexpr Parameters parameters() {
+    return {P::d, P::ds, P::s, P::a, P::c};
+  }
+
+  int size() const { return x.size(); }
+  void addBoid(const sf::Vector2<double>& position,
+               const sf::Vector2<double>& velocity) {
+    x.push_back(position.x);
+    y.push_back(position.y);
+    vx.push_back(velocity.x);
+    vy.push_back(velocity.y);
+  }
+  sf::Vector2<double> position(int i) const { return {x[i], y[i]}; }
+  sf::Vector2<double> velocity(int i) const { return {vx[i], vy[i]}; }
+  Boid getBoid(int i) const {
+    return Boid(position(i), velocity(i), parameters(), P::maxspeed);
+  }
+
+  // throws if a boid has other parameters or another speed limit
+  static FixedFlock fromFlock(const Flock& flock) {
+    FixedFlock fixed;
+    for (const auto& boid : flock.flock()) {
+      const Parameters par = boid.getPar();
+      if (par.d != P::d || par.ds != P::ds || par.s != P::s ||
+          par.a != P::a || par.c != P::c ||
+          boid.getMaxspeed() != P::maxspeed) {
+        throw std::runtime_error{
+            "Something went wrong. The boid parameters differ from the "
+            "compiled ones.\n"};
+      }
+      fixed.addBoid(boid.getPosition(), boid.getVelocity());
+    }
+    return fixed;
+  }
+
+  Flock toFlock() const {
+    Flock flock;
+    flock.reserve(size());
+    for (int i = 0; i < size(); ++i) {
+      flock.addBoid(getBoid(i));
+    }
+    return flock;
+  }
+
+  // every boid in turn, each one seeing the boids before it already moved
+  void updateFlock(double const delta_t) {
+    const int N = size();
+    for (int i = 0; i < N; ++i) {
+      BoidState st{x[i], y[i], vx[i], vy[i]};
+      updateStateFixed<P>(st, x.data(), y.data(), vx.data(), vy.data(), N,
+                          delta_t);
+      x[i] = st.x;
+      y[i] = st.y;
+      vx[i] = st.vx;
+      vy[i] = st.vy;
+    }
+  }
+};
+
+}  // namespace bd
+
+#endif
@@ -1,35 +1,425 @@
 #include "flock.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <iomanip>
 #include <iostream>
 #include <numeric>
 
+#include "grid.hpp"
+#include "hashgrid.hpp"
+#include "kdtree.hpp"
+#include "perception.hpp"
+#include "publisher.hpp"
+#include "rules.hpp"
+
 namespace bd {
-void Flock::addBoid(const Boid& b) { m_flock.push_back(b); }
+void OrderSums::add(const Boid& b) {
+  add(b.getPosition(), b.getVelocity());
+}
+
+void OrderSums::add(const sf::Vector2<double>& position,
+                    const sf::Vector2<double>& velocity) {
+  const sf::Vector2<double> v = velocity;
+  const sf::Vector2<double> r = minimumImage(origin, position);
+  const double speed1 = bd::magnitude(v);
+  const sf::Vector2<double> u =
+      speed1 > 0. ? v / speed1 : sf::Vector2<double>(0, 0);
+
+  n += 1.;
+  sum_v += speed1;
+  sum_v2 += speed1 * speed1;
+  sum_u += u;
+  sum_r += r;
+  sum_r2 += r.x * r.x + r.y * r.y;
+  sum_rxu += r.x * u.y - r.y * u.x;
+}
+
+OrderSums& OrderSums::operator+=(const OrderSums& other) {
+  n += other.n;
+  sum_v += other.sum_v;
+  sum_v2 += other.sum_v2;
+  sum_u += other.sum_u;
+  sum_r += other.sum_r;
+  sum_r2 += other.sum_r2;
+  sum_rxu += other.sum_rxu;
+  return *this;
+}
+
+OrderParameters OrderSums::result() const {
+  OrderParameters p;
+  if (n < 1.) return p;
+
+  p.polarization = bd::magnitude(sum_u) / n;
+
+  // sum of (r - r_c) x u = sum of r x u - r_c x sum of u
+  const sf::Vector2<double> rc = sum_r / n;
+  const double l = sum_rxu - (rc.x * sum_u.y - rc.y * sum_u.x);
+  const double rg2 = sum_r2 / n - (rc.x * rc.x + rc.y * rc.y);
+  if (rg2 > 0.) {
+    p.rotation = std::abs(l) / (n * std::sqrt(rg2));
+  }
+
+  p.speed.mean = sum_v / n;
+  if (n > 1.) {
+    p.speed.sigma = std::sqrt(
+        std::max(0., (sum_v2 - n * p.speed.mean * p.speed.mean) / (n - 1)));
+  }
+  return p;
+}
+
+void Flock::addBoid(const Boid& b) {
+  ++m_generation;
+  m_flock.push_back(b);
+}
+
+void Flock::setBoid(int i, const Boid& b) {
+  ++m_generation;
+  m_flock[i] = b;
+}
+
+// Separation, alignment and cohesion over the boids at the given indices.
+// In topological mode alignment and cohesion use the k nearest boids and
+// separation the boids close to it, whatever their rank.
+sf::Vector2<double> Flock::ruleChange(const Boid& boid,
+                                      const std::vector<Boid>& boids,
+                                      const std::vector<int>& neighbours,
+                                      const std::vector<int>& close) const {
+  if (topological_k > 0) {
+    return RulePipeline<Separation>{}.velocityChange(boid, boids, close) +
+           RulePipeline<TopologicalAlignment, TopologicalCohesion>{}
+               .velocityChange(boid, boids, neighbours);
+  }
+  return Reynolds{}.velocityChange(boid, boids, neighbours);
+}
+
+// same sequence as Boid::update, with the optional topological rules and
+// environment; close is the same list as neighbours in metric mode and self
+// the index of the boid
+int Flock::updateBoid(Boid& boid, int self, const std::vector<Boid>& boids,
+                      const std::vector<int>& neighbours,
+                      const std::vector<int>& close,
+                      double const delta_t) const {
+  const int k =
+      max_substeps > 1 ? substepsOf(boid, boids, neighbours, delta_t) : 1;
+  if (k == 1) {
+    boid.steer(ruleChange(boid, boids, neighbours, close));
+    if (environment) boid.steer(environment->steering(boid));
+    boid.updatePosition(delta_t);
+    boid.borders();
+    return 1;
+  }
 
-Boid Flock::getBoid(int i) const { return m_flock[i]; }
+  // the rules are evaluated again at every substep, on the boids within d
+  // that substepsOf looked at (and, in topological mode, the k nearest) and
+  // on the boid where it got to. The others move on straight lines from
+  // where they were at the start of the step, even those already updated.
+  const double d2 = boid.getPar().d * boid.getPar().d;
+  auto withinD = [&](const std::vector<int>& list, std::vector<int>& out) {
+    for (int j : list) {
+      const sf::Vector2<double> r =
+          minimumImage(boid.getPosition(), boids[j].getPosition());
+      if (r.x * r.x + r.y * r.y <= d2) out.push_back(j);
+    }
+  };
+  std::vector<int> local_neighbours;
+  std::vector<int> local_close;
+  if (topological_k > 0) {
+    local_neighbours = neighbours;
+    withinD(close, local_close);
+  } else {
+    withinD(neighbours, local_neighbours);
+    local_close = local_neighbours;
+  }
+  std::vector<int> all = local_neighbours;
+  all.insert(all.end(), local_close.begin(), local_close.end());
+  std::sort(all.begin(), all.end());
+  all.erase(std::unique(all.begin(), all.end()), all.end());
+  for (auto* list : {&local_neighbours, &local_close}) {
+    for (int& j : *list) {
+      j = std::lower_bound(all.begin(), all.end(), j) - all.begin();
+    }
+  }
+  std::vector<Boid> local;
+  local.reserve(all.size());
+  for (int j : all) {
+    local.push_back(boids[j]);
+    local.back().setVelocity(start_velocities[j]);
+  }
+  const int me = std::lower_bound(all.begin(), all.end(), self) - all.begin();
+  const bool listed = me < static_cast<int>(all.size()) && all[me] == self;
+  const double h = delta_t / k;
+  for (int step = 0; step < k; ++step) {
+    for (int j = 0, n = local.size(); j < n; ++j) {
+      local[j].setPosition(wrapPosition(start_positions[all[j]] +
+                                        start_velocities[all[j]] * (step * h)));
+    }
+    if (listed) local[me] = boid;
+    const sf::Vector2<double> dv =
+        ruleChange(boid, local, local_neighbours, local_close);
+    boid.steer(dv / static_cast<double>(k));
+    if (environment) {
+      boid.steer(environment->steering(boid) / static_cast<double>(k));
+    }
+    boid.updatePosition(h);
+    boid.borders();
+  }
+  return k;
+}
 
-Boid& Flock::getBoid(int i) { return m_flock[i]; }
+// substeps so that no neighbour within d gets closer by more than
+// substep_travel * ds in one of them
+int Flock::substepsOf(const Boid& boid, const std::vector<Boid>& boids,
+                      const std::vector<int>& neighbours,
+                      double const delta_t) const {
+  const Parameters par = boid.getPar();
+  const double step = substep_travel * par.ds;
+  if (!(step > 0.)) return 1;
+  const sf::Vector2<double> p = boid.getPosition();
+  const sf::Vector2<double> v = boid.getVelocity();
+  double fastest = 0.;
+  for (int j : neighbours) {
+    const Boid& other = boids[j];
+    const sf::Vector2<double> r = minimumImage(p, other.getPosition());
+    if (r.x * r.x + r.y * r.y >= par.d * par.d) continue;
+    const sf::Vector2<double> u = other.getVelocity() - v;
+    fastest = std::max(fastest, u.x * u.x + u.y * u.y);
+  }
+  const double k = std::ceil(std::sqrt(fastest) * std::abs(delta_t) / step);
+  if (!(k > 1.)) return 1;
+  return k < max_substeps ? static_cast<int>(k) : max_substeps;
+}
+
+void Flock::setSubsteps(int max, double travel) {
+  if (max < 1 || !(travel > 0.)) {
+    throw std::runtime_error{
+        "Something went wrong. Substeps need a positive cap and travel.\n"};
+  }
+  max_substeps = max;
+  substep_travel = travel;
+}
 
 // update of every boid inside the flock:
 void Flock::updateFlock(const double delta_t) {
-  for (auto& boid : m_flock) {
-    boid.update(m_flock, delta_t);
+  if (environment) environment->update(m_flock, delta_t);
+  if (max_substeps > 1) {
+    const int N = m_flock.size();
+    start_positions.resize(N);
+    start_velocities.resize(N);
+    for (int i = 0; i < N; ++i) {
+      start_positions[i] = m_flock[i].getPosition();
+      start_velocities[i] = m_flock[i].getVelocity();
+    }
+  }
+
+  // every boid is final as soon as it has been updated, so the order sums
+  // are collected while it is still in cache
+  OrderSums sums;
+  long extra = 0;
+  if (track_order && !m_flock.empty()) {
+    sums.origin = m_flock.front().getPosition();
+  }
+
+  if (topological_k > 0) {
+    // neighbours are chosen on the positions at the start of the step
+    KdTree tree;
+    tree.build(m_flock);
+    // separation sees every boid within ds: the candidates of a grid whose
+    // cells leave room for the boids already moved in this loop
+    double radius = 0.;
+    double margin = 0.;
+    for (const auto& boid : m_flock) {
+      radius = std::max(radius, boid.getPar().ds);
+      margin = std::max(margin, boid.getMaxspeed() * std::abs(delta_t));
+    }
+    if (!std::isfinite(margin)) margin = worldWidth;
+    SpatialGrid grid(std::max(radius + margin, 1.));
+    grid.build(m_flock);
+
+    std::vector<int> nearest;
+    std::vector<int> close;
+    for (int i = 0, N = m_flock.size(); i < N; ++i) {
+      Boid& boid = m_flock[i];
+      tree.nearest(boid.getPosition(), topological_k, nearest, i);
+      nearest.push_back(i);
+      // in index order, as the metric rules see them
+      std::sort(nearest.begin(), nearest.end());
+      grid.candidates(boid.getPosition(), close);
+      extra += updateBoid(boid, i, m_flock, nearest, close, delta_t) - 1;
+      if (track_order) sums.add(boid);
+    }
+  } else if (scheduler) {
+    extra = updateParallel(delta_t, track_order ? &sums : nullptr);
+  } else if (!perception.isActive()) {
+    std::vector<int> all(m_flock.size());
+    std::iota(all.begin(), all.end(), 0);
+    for (int i = 0, N = m_flock.size(); i < N; ++i) {
+      Boid& boid = m_flock[i];
+      extra += updateBoid(boid, i, m_flock, all, all, delta_t) - 1;
+      if (track_order) sums.add(boid);
+    }
+  } else {
+    // boids already updated in this loop may have moved by up to
+    // maxspeed * delta_t since the grid was built: its cells get that margin
+    double radius = 0.;
+    double margin = 0.;
+    for (const auto& boid : m_flock) {
+      radius = std::max(radius, boid.getPar().d);
+      margin = std::max(margin, boid.getMaxspeed() * std::abs(delta_t));
+    }
+    if (!std::isfinite(margin)) margin = worldWidth;
+    SpatialGrid grid(std::max(radius + margin, 1.));
+    grid.build(m_flock);
+
+    std::vector<int> candidates;
+    std::vector<int> visible;
+    for (int i = 0, N = m_flock.size(); i < N; ++i) {
+      Boid& boid = m_flock[i];
+      grid.candidates(boid.getPosition(), candidates);
+      visibleNeighbours(i, m_flock, candidates, boid.getPar().d, perception,
+                        visible);
+      extra += updateBoid(boid, i, m_flock, visible, visible, delta_t) - 1;
+      if (track_order) sums.add(boid);
+    }
+  }
+
+  extra_substeps = extra;
+  ++m_generation;
+  if (track_order) order.set(sums.result(), m_generation);
+  if (publisher) publisher->publish(*this);
+}
+
+// Jacobi update: neighbours are read from a copy of the flock at the start
+// of the step, so the boids can be updated in any order and in parallel.
+// With the candidates of the grid in index order, every boid gets the same
+// result, bit for bit, as Boid::update over the whole copy.
+long Flock::updateParallel(double const delta_t, OrderSums* sums) {
+  const std::vector<Boid> start = m_flock;
+  double radius = 0.;
+  for (const auto& boid : start) {
+    radius = std::max(radius, boid.getPar().d);
+  }
+  // the sparse grid splits the crowded cells, so that a boid in a dense
+  // cluster looks at about its true neighbours instead of a whole 3x3 block
+  HashedGrid grid(std::max(radius, 1.));
+  grid.build(start);
+
+  // cost of a leaf: its boids times the candidates of one of them
+  const int L = grid.leaves();
+  std::vector<double> weights(L);
+  std::vector<int> candidates;
+  for (int l = 0; l < L; ++l) {
+    const int i = *grid.leafBegin(l);
+    grid.candidates(start[i].getPosition(), start[i].getPar().d, candidates);
+    weights[l] = static_cast<double>(grid.leafSize(l)) * candidates.size();
+  }
+
+  // order sums of every chunk, kept at the index of its first leaf and
+  // merged in that order at the end
+  std::vector<OrderSums> partial(sums ? L : 0);
+  std::atomic<long> extra{0};
+  scheduler->run(weights, [&](int begin, int end) {
+    std::vector<int> candidates;
+    std::vector<int> visible;
+    OrderSums order_sums;
+    if (sums) order_sums.origin = sums->origin;
+    long mine = 0;
+    for (int l = begin; l < end; ++l) {
+      for (const int* i = grid.leafBegin(l); i != grid.leafEnd(l); ++i) {
+        Boid boid = start[*i];
+        grid.candidates(boid.getPosition(), boid.getPar().d, candidates);
+        visibleNeighbours(*i, start, candidates, boid.getPar().d, perception,
+                          visible);
+        mine += updateBoid(boid, *i, start, visible, visible, delta_t) - 1;
+        m_flock[*i] = boid;
+        if (sums) order_sums.add(boid);
+      }
+    }
+    if (sums) partial[begin] = order_sums;
+    extra += mine;
+  });
+  if (sums) {
+    for (const OrderSums& p : partial) *sums += p;
+  }
+  return extra;
+}
+
+void Flock::setTopological(int k) {
+  if (k < 0) {
+    throw std::runtime_error{
+        "Something went wrong. The number of neighbours must be positive.\n"};
+  }
+  topological_k = k;
+}
+
+OrderParameters Flock::orderParameters() const {
+  if (!order.fresh(m_generation)) {
+    OrderSums sums;
+    if (!m_flock.empty()) sums.origin = m_flock.front().getPosition();
+    for (const auto& boid : m_flock) {
+      sums.add(boid);
+    }
+    order.set(sums.result(), m_generation);
+  }
+  return order.value;
+}
+
+Bounds Flock::bounds() const {
+  if (!box.fresh(m_generation)) {
+    Bounds b;
+    if (!m_flock.empty()) {
+      b.min = b.max = m_flock.front().getPosition();
+    }
+    for (const auto& boid : m_flock) {
+      const sf::Vector2<double> p = boid.getPosition();
+      b.min = {std::min(b.min.x, p.x), std::min(b.min.y, p.y)};
+      b.max = {std::max(b.max.x, p.x), std::max(b.max.y, p.y)};
+    }
+    box.set(b, m_generation);
+  }
+  return box.value;
+}
+
+sf::Vector2<double> Flock::centroid() const {
+  if (!center.fresh(m_generation)) {
+    sf::Vector2<double> c;
+    if (!m_flock.empty()) {
+      const sf::Vector2<double> origin = m_flock.front().getPosition();
+      sf::Vector2<double> sum;
+      for (const auto& boid : m_flock) {
+        sum += minimumImage(origin, boid.getPosition());
+      }
+      c = wrapPosition(origin + sum / static_cast<double>(size()));
+    }
+    center.set(c, m_generation);
+  }
+  return center.value;
+}
+
+const SpatialGrid& Flock::spatialIndex(double cell_size) const {
+  if (!index.fresh(m_generation) || index_cell != cell_size) {
+    // a new grid, as copies of the flock may still share the old one
+    auto grid = std::make_shared<SpatialGrid>(cell_size);
+    grid->build(m_flock);
+    index.set(std::move(grid), m_generation);
+    index_cell = cell_size;
   }
+  return *index.value;
 }
 
-Statistics Flock::average_distance() {
-  int N = (*this).size();
+Statistics distanceStatistics(
+    const std::vector<sf::Vector2<double>>& positions) {
+  int N = positions.size();
   double sum_d = 0.0;
   double sum_d2 = 0.0;
   int pair_count = 0;
 
   for (int i = 0; i < N; i++) {
-    const sf::Vector2<double>& pos1 = getBoid(i).getPosition();
+    const sf::Vector2<double>& pos1 = positions[i];
     for (int j = i + 1; j < N; j++) {
-      const sf::Vector2<double>& pos2 = getBoid(j).getPosition();
+      const sf::Vector2<double>& pos2 = positions[j];
 
       double distance1 = bd::distance(pos1, pos2);
       assert(distance1 >= 0.);
@@ -52,24 +442,25 @@ Statistics Flock::average_distance() {
   return {average_distance, sigma_d};
 }
 
-Statistics Flock::average_speed() {
-  int N = (*this).size();
+Statistics speedStatistics(const std::vector<sf::Vector2<double>>& velocities,
+                           MathMode mode) {
+  int N = velocities.size();
   struct Sums {
     double sum_v = 0.0;
     double sum_v2 = 0.0;
   };
 
-  /*for (auto const& boid : m_flock) {
-    const sf::Vector2<double>& v = boid.getVelocity();
-
-    double speed1 = bd::magnitude(v);
-    sum_v += speed1;
-    sum_v2 += speed1 * speed1;
-  }*/
+  std::vector<double> vx(N);
+  std::vector<double> vy(N);
+  for (int i = 0; i < N; ++i) {
+    vx[i] = velocities[i].x;
+    vy[i] = velocities[i].y;
+  }
+  std::vector<double> speeds1(N);
+  magnitudes(vx.data(), vy.data(), speeds1.data(), N, mode);
 
-  Sums s = std::accumulate(flock().begin(), flock().end(), Sums{},
-                           [](Sums s, const Boid& boid) {
-                             double speed1 = bd::magnitude(boid.getVelocity());
+  Sums s = std::accumulate(speeds1.begin(), speeds1.end(), Sums{},
+                           [](Sums s, double speed1) {
                              s.sum_v += speed1;
                              s.sum_v2 += speed1 * speed1;
                              return s;
@@ -87,22 +478,58 @@ Statistics Flock::average_speed() {
   return {average_speed, sigma_v};
 }
 
+OrderParameters orderParameters(
+    const std::vector<sf::Vector2<double>>& positions,
+    const std::vector<sf::Vector2<double>>& velocities) {
+  OrderSums sums;
+  if (!positions.empty()) sums.origin = positions.front();
+  for (int i = 0, n = positions.size(); i < n; ++i) {
+    sums.add(positions[i], velocities[i]);
+  }
+  return sums.result();
+}
+
+Statistics Flock::average_distance() const {
+  if (distance_stats.fresh(m_generation)) return distance_stats.value;
+  std::vector<sf::Vector2<double>> positions(m_flock.size());
+  for (int i = 0, n = m_flock.size(); i < n; ++i) {
+    positions[i] = m_flock[i].getPosition();
+  }
+  return distance_stats.set(distanceStatistics(positions), m_generation);
+}
+
+Statistics Flock::average_speed() const {
+  if (speed_stats.fresh(m_generation)) return speed_stats.value;
+  std::vector<sf::Vector2<double>> velocities(m_flock.size());
+  for (int i = 0, n = m_flock.size(); i < n; ++i) {
+    velocities[i] = m_flock[i].getVelocity();
+  }
+  return speed_stats.set(speedStatistics(velocities, math), m_generation);
+}
+
 void Flock::setParameters(const Parameters& par1) {
+  // checked once for the whole flock
+  validate(par1);
+  ++m_generation;
   for (auto& boid : m_flock) {
-    boid.setPar(par1);
-  };  // exception handling already included in call to setPar
+    boid = Boid(boid.getPosition(), boid.getVelocity(), par1,
+                boid.getMaxspeed());
+  }
 }
 
 void Flock::setColor(const Color& c) {
   f_color = c;
 }
 
-Color Flock::getColor() {return f_color;};
+Color Flock::getColor() const {return f_color;};
 
-void Flock::resetFlock() { m_flock.clear(); }
+void Flock::resetFlock() {
+  ++m_generation;
+  m_flock.clear();
+}
 
-void histogram(std::vector<double> entries, std::vector<double> errors,
-               double norm) {
+void histogram(const std::vector<double>& entries,
+               const std::vector<double>& errors, double norm) {
   if (entries.size() < 2) {
     throw std::runtime_error{"Not enough entries to draw a histogram."};
   }
@@ -2,17 +2,80 @@
 #ifndef FLOCK_HPP
 #define FLOCK_HPP
 
+#include <cstdint>
+#include <memory>
+
 #include "boid.hpp"
+#include "fastmath.hpp"
+#include "grid.hpp"
+#include "obstacle.hpp"
+#include "perception.hpp"
+#include "scheduler.hpp"
 
 namespace bd {
 
-  void histogram(std::vector<double>, std::vector<double>, double norm);
+  class SnapshotPublisher;
+
+  void histogram(const std::vector<double>& entries,
+                 const std::vector<double>& errors, double norm);
 
   struct Statistics{
     double mean{};
     double sigma{};
   };
 
+  // polarization |sum of v/|v|| / N, between 0 (disordered) and 1 (aligned);
+  // rotation |sum of (r - r_c) x v/|v|| / (N R_g), between 0 and 1 (mill),
+  // with positions taken relative to the first boid on the torus and R_g the
+  // radius of gyration
+  struct OrderParameters{
+    double polarization{};
+    double rotation{};
+    Statistics speed{};
+  };
+
+  // sums from which the order parameters are computed: they can be
+  // accumulated in any order and partial sums (e.g. of different threads)
+  // are merged with +=
+  struct OrderSums{
+    sf::Vector2<double> origin;
+    double n{};
+    double sum_v{};
+    double sum_v2{};
+    sf::Vector2<double> sum_u;
+    sf::Vector2<double> sum_r;
+    double sum_r2{};
+    double sum_rxu{};
+
+    void add(const Boid& b);
+    void add(const sf::Vector2<double>& position,
+             const sf::Vector2<double>& velocity);
+    OrderSums& operator+=(const OrderSums& other);
+    OrderParameters result() const;
+  };
+
+  // axis-aligned box around the positions (not wrapped on the torus)
+  struct Bounds{
+    sf::Vector2<double> min;
+    sf::Vector2<double> max;
+  };
+
+  // a quantity derived from the boids and the generation it belongs to
+  template <class T>
+  struct Cached{
+    T value{};
+    std::uint64_t generation{};
+    bool valid{};
+
+    bool fresh(std::uint64_t g) const { return valid && generation == g; }
+    const T& set(T v, std::uint64_t g) {
+      value = std::move(v);
+      generation = g;
+      valid = true;
+      return value;
+    }
+  };
+
   struct Color{
     double red{};
     double green{};
@@ -22,36 +85,175 @@ namespace bd {
 class Flock {
   std::vector<Boid> m_flock;
   Color f_color;
-  
+  MathMode math{MathMode::Exact};
+  bool track_order{};
+
+  // bumped by every change of the boids (update, addBoid, setBoid, the
+  // Mutation handles); the derived quantities below are recomputed only
+  // when they belong to an older generation
+  std::uint64_t m_generation{};
+  mutable Cached<OrderParameters> order;
+  mutable Cached<Statistics> distance_stats;
+  mutable Cached<Statistics> speed_stats;
+  mutable Cached<Bounds> box;
+  mutable Cached<sf::Vector2<double>> center;
+  mutable Cached<std::shared_ptr<SpatialGrid>> index;
+  mutable double index_cell{};
+  std::shared_ptr<Environment> environment;
+  Perception perception;
+  int topological_k{};
+  std::shared_ptr<AdaptiveScheduler> scheduler;
+  std::shared_ptr<SnapshotPublisher> publisher;
+  int max_substeps{1};
+  double substep_travel{0.5};
+  long extra_substeps{};
+  // the boids at the start of the step, from which the substeps move the
+  // neighbours (filled only when substeps are on)
+  std::vector<sf::Vector2<double>> start_positions;
+  std::vector<sf::Vector2<double>> start_velocities;
+
+  // returns the number of substeps the boid took
+  sf::Vector2<double> ruleChange(const Boid& boid,
+                                 const std::vector<Boid>& boids,
+                                 const std::vector<int>& neighbours,
+                                 const std::vector<int>& close) const;
+  int updateBoid(Boid& boid, int self, const std::vector<Boid>& boids,
+                 const std::vector<int>& neighbours,
+                 const std::vector<int>& close, double const delta_t) const;
+  int substepsOf(const Boid& boid, const std::vector<Boid>& boids,
+                 const std::vector<int>& neighbours,
+                 double const delta_t) const;
+  // returns the extra substeps; adds the updated boids to sums if not null
+  long updateParallel(double const delta_t, OrderSums* sums);
 
  public:
 
   int size() const { return m_flock.size(); }
 
-  auto& flock() { return m_flock; }
-  const auto& flock() const { return m_flock; }
+  // Write access to the boids for as long as the handle lives. The
+  // generation is bumped when it is taken and again when it goes away, so
+  // observables queried after the changes never come from the cache of an
+  // older state. Keep the handle, not references taken from it:
+  //   for (Boid& b : flock.mutate()) b.setMaxspeed(100);
+  class Mutation {
+    Flock& owner;
 
+   public:
+    explicit Mutation(Flock& f) : owner{f} { ++owner.m_generation; }
+    ~Mutation() { ++owner.m_generation; }
+    Mutation(const Mutation&) = delete;
+    Mutation& operator=(const Mutation&) = delete;
 
-  Boid getBoid(int i) const;
-  Boid& getBoid(int i);
+    std::vector<Boid>& boids() const { return owner.m_flock; }
+    Boid& operator[](int i) const { return owner.m_flock[i]; }
+    int size() const { return owner.m_flock.size(); }
+    auto begin() const { return owner.m_flock.begin(); }
+    auto end() const { return owner.m_flock.end(); }
+  };
+  Mutation mutate() { return Mutation(*this); }
+
+  const std::vector<Boid>& flock() const { return m_flock; }
+
+  const Boid& getBoid(int i) const { return m_flock[i]; }
+  // replaces boid i
+  void setBoid(int i, const Boid& b);
 
   void addBoid(const Boid& b);
+  // room for n boids, so that addBoid does not reallocate
+  void reserve(int n) { m_flock.reserve(n); }
 
   void updateFlock(double const delta_t);
 
-  Statistics average_distance();
+  // changes at every update and at every change of the boids
+  std::uint64_t generation() const { return m_generation; }
+
+  // The observables below are cached: calling them again before the boids
+  // change costs nothing. Not safe to call from several threads at once.
+  Statistics average_distance() const;
 
-  Statistics average_speed();
+  Statistics average_speed() const;
+
+  Bounds bounds() const;
+  // mean position on the torus, taken relative to the first boid
+  sf::Vector2<double> centroid() const;
+  // grid of the current positions, rebuilt only for a new generation or
+  // cell size
+  const SpatialGrid& spatialIndex(double cell_size) const;
 
   void setParameters(const Parameters& par1);
 
+  // obstacles and predators the boids avoid (nullptr: none)
+  void setEnvironment(std::shared_ptr<Environment> env) {
+    environment = std::move(env);
+  }
+
+  // field of view and neighbour cap of every boid of the flock; the
+  // default sees every boid within d
+  void setPerception(const Perception& p) { perception = p; }
+
+  // topological interaction: alignment and cohesion with exactly the k
+  // nearest boids (from a KD-tree rebuilt every step) instead of those
+  // within d; separation keeps its radius ds and sees every boid within it,
+  // nearest or not. 0 restores the metric rules, the perception cone is not
+  // applied in this mode.
+  void setTopological(int k);
+
+  // parallel update (nullptr: the sequential one). Every boid then sees the
+  // others as they were at the start of the step, instead of the boids
+  // before it already moved; the work is split by the leaves of a sparse
+  // grid (hashgrid.hpp) weighted by their number of candidates. Not used in
+  // topological mode.
+  void setScheduler(std::shared_ptr<AdaptiveScheduler> s) {
+    scheduler = std::move(s);
+  }
+
+  // adaptive substeps: a boid whose relative speed u to a boid within d
+  // would carry it farther than travel * ds in one step takes
+  // ceil(u delta_t / (travel ds)) substeps, at most max_substeps. At every
+  // substep the rules are evaluated again, with the others within d moving
+  // on straight lines from the start of the step, and 1/k of the velocity
+  // change and of the time is applied; every other boid takes a single
+  // step. 1 (the default) turns it off.
+  void setSubsteps(int max_substeps, double travel = 0.5);
+  // substeps beyond one per boid taken by the last update
+  long extraSubsteps() const { return extra_substeps; }
+
+  // every update ends by copying the positions and velocities into shared
+  // memory for other processes (publisher.hpp); nullptr: not published
+  void setPublisher(std::shared_ptr<SnapshotPublisher> p) {
+    publisher = std::move(p);
+  }
+
+  // accumulate the order parameters while updating the flock
+  void setOrderTracking(bool on) { track_order = on; }
+  bool orderTracking() const { return track_order; }
+  // last values accumulated by updateFlock, or a fresh computation
+  OrderParameters orderParameters() const;
+
+  // precision of the batch math used by the statistics
+  void setMathMode(MathMode mode) {
+    math = mode;
+    ++m_generation;
+  }
+
   void setColor(const Color& c1);
-  Color getColor();
+  Color getColor() const;
 
   void resetFlock();
 
 };
 
+  // the observables of a flock computed from its positions and velocities
+  // alone (e.g. those of a Snapshot), with the same results as the methods
+  Statistics distanceStatistics(
+      const std::vector<sf::Vector2<double>>& positions);
+  Statistics speedStatistics(
+      const std::vector<sf::Vector2<double>>& velocities,
+      MathMode mode = MathMode::Exact);
+  OrderParameters orderParameters(
+      const std::vector<sf::Vector2<double>>& positions,
+      const std::vector<sf::Vector2<double>>& velocities);
+
 }  // namespace bd
 
 #endif
\ No newline at end of file
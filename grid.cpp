@@ -0,0 +1,112 @@
+#include "grid.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace bd {
+
+sf::Vector2<double> minimumImage(const sf::Vector2<double>& from,
+                                 const sf::Vector2<double>& to) {
+  double dx = to.x - from.x;
+  double dy = to.y - from.y;
+  if (dx > worldWidth / 2) dx -= worldWidth;
+  if (dx < -worldWidth / 2) dx += worldWidth;
+  if (dy > worldHeight / 2) dy -= worldHeight;
+  if (dy < -worldHeight / 2) dy += worldHeight;
+  return {dx, dy};
+}
+
+sf::Vector2<double> wrapPosition(const sf::Vector2<double>& p) {
+  double x = std::fmod(p.x, worldWidth);
+  double y = std::fmod(p.y, worldHeight);
+  if (x < 0.) x += worldWidth;
+  if (y < 0.) y += worldHeight;
+  return {x, y};
+}
+
+double periodicGap(double p, double lo, double hi, double L) {
+  if (p >= lo && p <= hi) return 0.;
+  double left = std::fmod(lo - p, L);
+  double right = std::fmod(p - hi, L);
+  if (left < 0.) left += L;
+  if (right < 0.) right += L;
+  return std::min(left, right);
+}
+
+SpatialGrid::SpatialGrid(double cell_size) {
+  if (!(cell_size > 0.)) {
+    throw std::runtime_error{
+        "Something went wrong. The grid cells must have a positive size.\n"};
+  }
+  m_columns = std::max(1, static_cast<int>(worldWidth / cell_size));
+  m_rows = std::max(1, static_cast<int>(worldHeight / cell_size));
+  cell_start.assign(cells() + 1, 0);
+}
+
+int SpatialGrid::cellOf(const sf::Vector2<double>& p) const {
+  int cx = static_cast<int>(std::floor(p.x / worldWidth * m_columns));
+  int cy = static_cast<int>(std::floor(p.y / worldHeight * m_rows));
+  // positions on (or, after an update, slightly past) the border wrap around
+  cx = ((cx % m_columns) + m_columns) % m_columns;
+  cy = ((cy % m_rows) + m_rows) % m_rows;
+  return cy * m_columns + cx;
+}
+
+void SpatialGrid::build(const std::vector<sf::Vector2<double>>& positions) {
+  const int N = positions.size();
+  item_cell.resize(N);
+  cell_start.assign(cells() + 1, 0);
+
+  for (int i = 0; i < N; ++i) {
+    item_cell[i] = cellOf(positions[i]);
+    ++cell_start[item_cell[i] + 1];
+  }
+  for (int c = 0; c < cells(); ++c) {
+    cell_start[c + 1] += cell_start[c];
+  }
+
+  items.resize(N);
+  std::vector<int> fill(cell_start.begin(), cell_start.end() - 1);
+  for (int i = 0; i < N; ++i) {
+    items[fill[item_cell[i]]++] = i;
+  }
+}
+
+void SpatialGrid::build(const std::vector<Boid>& boids) {
+  std::vector<sf::Vector2<double>> positions(boids.size());
+  for (int i = 0, N = boids.size(); i < N; ++i) {
+    positions[i] = boids[i].getPosition();
+  }
+  build(positions);
+}
+
+int SpatialGrid::neighbourCells(int cell, int out[9]) const {
+  const int cx = cell % m_columns;
+  const int cy = cell / m_columns;
+  int n = 0;
+  for (int dy = -1; dy <= 1; ++dy) {
+    for (int dx = -1; dx <= 1; ++dx) {
+      int x = (cx + dx + m_columns) % m_columns;
+      int y = (cy + dy + m_rows) % m_rows;
+      int c = y * m_columns + x;
+      if (std::find(out, out + n, c) == out + n) {
+        out[n++] = c;
+      }
+    }
+  }
+  return n;
+}
+
+void SpatialGrid::candidates(const sf::Vector2<double>& p,
+                             std::vector<int>& out) const {
+  out.clear();
+  int around[9];
+  int n = neighbourCells(cellOf(p), around);
+  for (int k = 0; k < n; ++k) {
+    out.insert(out.end(), cellBegin(around[k]), cellEnd(around[k]));
+  }
+  std::sort(out.begin(), out.end());
+}
+
+}  // namespace bd
@@ -0,0 +1,62 @@
+#pragma once
+#ifndef GRID_HPP
+#define GRID_HPP
+
+#include <vector>
+
+#include "boid.hpp"
+
+namespace bd {
+
+// shortest vector between two points of the toroidal world
+sf::Vector2<double> minimumImage(const sf::Vector2<double>& from,
+                                 const sf::Vector2<double>& to);
+// the same point brought back inside [0, worldWidth) x [0, worldHeight)
+sf::Vector2<double> wrapPosition(const sf::Vector2<double>& p);
+// gap between a coordinate and an interval on a circle of length L
+double periodicGap(double p, double lo, double hi, double L);
+
+// uniform periodic grid over the world. The cells are at least cell_size
+// wide, so every point closer than cell_size to p lies in the 3x3 block of
+// cells around the cell of p. Boid indices are stored sorted by cell
+// (counting sort), the grid is rebuilt from scratch every step.
+class SpatialGrid {
+  int m_columns{};
+  int m_rows{};
+  std::vector<int> cell_start;  // cells() + 1 offsets into items
+  std::vector<int> items;
+  std::vector<int> item_cell;
+
+ public:
+  explicit SpatialGrid(double cell_size);
+
+  int columns() const { return m_columns; }
+  int rows() const { return m_rows; }
+  int cells() const { return m_columns * m_rows; }
+
+  int cellOf(const sf::Vector2<double>& p) const;
+
+  void build(const std::vector<sf::Vector2<double>>& positions);
+  void build(const std::vector<Boid>& boids);
+
+  // indices of the boids inside a cell
+  const int* cellBegin(int cell) const { return items.data() + cell_start[cell]; }
+  const int* cellEnd(int cell) const {
+    return items.data() + cell_start[cell + 1];
+  }
+  int cellSize(int cell) const {
+    return cell_start[cell + 1] - cell_start[cell];
+  }
+  int cellOfItem(int i) const { return item_cell[i]; }
+
+  // the distinct cells of the 3x3 block around a cell (less than 9 when the
+  // grid has fewer than 3 columns or rows); returns how many were written
+  int neighbourCells(int cell, int out[9]) const;
+
+  // indices of all the boids in the 3x3 block around p, sorted
+  void candidates(const sf::Vector2<double>& p, std::vector<int>& out) const;
+};
+
+}  // namespace bd
+
+#endif
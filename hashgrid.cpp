@@ -0,0 +1,192 @@
+#include "hashgrid.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+#include "grid.hpp"
+
+namespace bd {
+
+HashedGrid::HashedGrid(double cell_size, int leaf_capacity, int max_depth)
+    : leaf_capacity{leaf_capacity},
+      max_depth{max_depth},
+      max_radius{cell_size} {
+  if (!(cell_size > 0.)) {
+    throw std::runtime_error{
+        "Something went wrong. The grid cells must have a positive size.\n"};
+  }
+  if (leaf_capacity < 1 || max_depth < 0) {
+    throw std::runtime_error{
+        "Something went wrong. The leaves must hold at least one boid.\n"};
+  }
+  m_columns = std::max(1, static_cast<int>(worldWidth / cell_size));
+  m_rows = std::max(1, static_cast<int>(worldHeight / cell_size));
+}
+
+int HashedGrid::cellOf(const sf::Vector2<double>& p) const {
+  int cx = static_cast<int>(std::floor(p.x / worldWidth * m_columns));
+  int cy = static_cast<int>(std::floor(p.y / worldHeight * m_rows));
+  cx = ((cx % m_columns) + m_columns) % m_columns;
+  cy = ((cy % m_rows) + m_rows) % m_rows;
+  return cy * m_columns + cx;
+}
+
+static std::size_t slot(int cell, std::size_t mask) {
+  return (static_cast<std::uint32_t>(cell) * 2654435761u) & mask;
+}
+
+int HashedGrid::root(int cell) const {
+  const std::size_t mask = table.size() - 1;
+  for (std::size_t s = slot(cell, mask);; s = (s + 1) & mask) {
+    if (table[s].first == cell) return table[s].second;
+    if (table[s].first == -1) return -1;
+  }
+}
+
+void HashedGrid::build(const std::vector<sf::Vector2<double>>& positions) {
+  const int N = positions.size();
+  points.resize(N);
+  std::vector<std::pair<int, int>> keyed(N);
+  for (int i = 0; i < N; ++i) {
+    // on the border, or slightly past it after an update: back inside, so
+    // that every point lies in the box of its cell
+    points[i] = wrapPosition(positions[i]);
+    keyed[i] = {cellOf(points[i]), i};
+  }
+  std::sort(keyed.begin(), keyed.end());
+
+  items.resize(N);
+  occupied = 0;
+  for (int i = 0; i < N; ++i) {
+    items[i] = keyed[i].second;
+    if (i == 0 || keyed[i].first != keyed[i - 1].first) ++occupied;
+  }
+
+  std::size_t capacity = 8;
+  while (capacity < 2 * static_cast<std::size_t>(occupied)) capacity *= 2;
+  table.assign(capacity, {-1, -1});
+  nodes.clear();
+  m_leaves.clear();
+
+  const double w = cellWidth();
+  const double h = cellHeight();
+  for (int begin = 0; begin < N;) {
+    const int cell = keyed[begin].first;
+    int end = begin;
+    while (end < N && keyed[end].first == cell) ++end;
+
+    const int cx = cell % m_columns;
+    const int cy = cell / m_columns;
+    const int node = nodes.size();
+    nodes.push_back({cx * w, cy * h, (cx + 1) * w, (cy + 1) * h, begin, end,
+                     -1});
+    std::size_t s = slot(cell, capacity - 1);
+    while (table[s].first != -1) s = (s + 1) & (capacity - 1);
+    table[s] = {cell, node};
+
+    split(node, 0);
+    begin = end;
+  }
+}
+
+void HashedGrid::build(const std::vector<Boid>& boids) {
+  std::vector<sf::Vector2<double>> positions(boids.size());
+  for (int i = 0, N = boids.size(); i < N; ++i) {
+    positions[i] = boids[i].getPosition();
+  }
+  build(positions);
+}
+
+void HashedGrid::split(int node, int depth) {
+  // nodes may grow below: work on a copy
+  const Node n = nodes[node];
+  if (n.end - n.begin <= leaf_capacity || depth >= max_depth) {
+    m_leaves.push_back(node);
+    return;
+  }
+  const double mx = (n.x0 + n.x1) / 2;
+  const double my = (n.y0 + n.y1) / 2;
+  int* first = items.data() + n.begin;
+  int* last = items.data() + n.end;
+  int* y_split = std::partition(
+      first, last, [this, my](int i) { return points[i].y < my; });
+  int* low_x = std::partition(
+      first, y_split, [this, mx](int i) { return points[i].x < mx; });
+  int* high_x = std::partition(
+      y_split, last, [this, mx](int i) { return points[i].x < mx; });
+  const int a = low_x - items.data();
+  const int b = y_split - items.data();
+  const int c = high_x - items.data();
+
+  const int child = nodes.size();
+  nodes[node].child = child;
+  nodes.push_back({n.x0, n.y0, mx, my, n.begin, a, -1});
+  nodes.push_back({mx, n.y0, n.x1, my, a, b, -1});
+  nodes.push_back({n.x0, my, mx, n.y1, b, c, -1});
+  nodes.push_back({mx, my, n.x1, n.y1, c, n.end, -1});
+  for (int k = 0; k < 4; ++k) {
+    if (nodes[child + k].end > nodes[child + k].begin) {
+      split(child + k, depth + 1);
+    }
+  }
+}
+
+std::size_t HashedGrid::bytes() const {
+  return points.capacity() * sizeof(points[0]) +
+         items.capacity() * sizeof(int) + nodes.capacity() * sizeof(Node) +
+         m_leaves.capacity() * sizeof(int) +
+         table.capacity() * sizeof(table[0]);
+}
+
+void HashedGrid::collect(int node, const sf::Vector2<double>& p,
+                         double radius, std::vector<int>& out) const {
+  const Node& n = nodes[node];
+  if (n.end == n.begin) return;
+  const double gx = periodicGap(p.x, n.x0, n.x1, worldWidth);
+  const double gy = periodicGap(p.y, n.y0, n.y1, worldHeight);
+  // a little slack against rounding at the edge of the radius
+  if (gx * gx + gy * gy > radius * radius * (1 + 1e-9)) return;
+  if (n.child < 0) {
+    out.insert(out.end(), items.data() + n.begin, items.data() + n.end);
+    return;
+  }
+  for (int k = 0; k < 4; ++k) {
+    collect(n.child + k, p, radius, out);
+  }
+}
+
+void HashedGrid::candidates(const sf::Vector2<double>& p, double radius,
+                            std::vector<int>& out) const {
+  if (radius > max_radius) {
+    throw std::runtime_error{
+        "Something went wrong. The radius of a query must not exceed the "
+        "cell size.\n"};
+  }
+  out.clear();
+  if (nodes.empty()) return;
+  const sf::Vector2<double> q = wrapPosition(p);
+  const int cell = cellOf(q);
+  const int cx = cell % m_columns;
+  const int cy = cell / m_columns;
+  int around[9];
+  int n = 0;
+  for (int dy = -1; dy <= 1; ++dy) {
+    for (int dx = -1; dx <= 1; ++dx) {
+      const int x = (cx + dx + m_columns) % m_columns;
+      const int y = (cy + dy + m_rows) % m_rows;
+      const int c = y * m_columns + x;
+      if (std::find(around, around + n, c) == around + n) {
+        around[n++] = c;
+      }
+    }
+  }
+  for (int k = 0; k < n; ++k) {
+    const int node = root(around[k]);
+    if (node >= 0) collect(node, q, radius, out);
+  }
+  std::sort(out.begin(), out.end());
+}
+
+}  // namespace bd
@@ -0,0 +1,84 @@
+#pragma once
+#ifndef HASHGRID_HPP
+#define HASHGRID_HPP
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "boid.hpp"
+
+namespace bd {
+
+// Sparse periodic grid for very uneven densities. Only the occupied cells
+// are stored, in a hash table, and a cell holding more than leaf_capacity
+// boids is split into quadrants, again and again up to max_depth levels,
+// so a query skips the parts of its 3x3 block farther than the radius.
+// Memory goes with the number of boids and occupied cells, not with the
+// area of the world. Rebuilt from scratch every step.
+class HashedGrid {
+  struct Node {
+    double x0, y0, x1, y1;
+    int begin, end;  // range of items
+    int child;       // first of the four children, -1 for a leaf
+  };
+
+  int m_columns{};
+  int m_rows{};
+  int leaf_capacity{};
+  int max_depth{};
+  double max_radius{};
+  std::vector<sf::Vector2<double>> points;  // wrapped positions
+  std::vector<int> items;                   // boid indices, grouped by node
+  std::vector<Node> nodes;
+  std::vector<int> m_leaves;
+  // open addressing: (cell, root node), cell -1 when empty
+  std::vector<std::pair<int, int>> table;
+  int occupied{};
+
+  int root(int cell) const;
+  void split(int node, int depth);
+  void collect(int node, const sf::Vector2<double>& p, double radius,
+               std::vector<int>& out) const;
+
+ public:
+  // cell_size: the largest radius of the queries
+  explicit HashedGrid(double cell_size, int leaf_capacity = 16,
+                      int max_depth = 6);
+
+  int columns() const { return m_columns; }
+  int rows() const { return m_rows; }
+  double cellWidth() const { return worldWidth / m_columns; }
+  double cellHeight() const { return worldHeight / m_rows; }
+  int cellOf(const sf::Vector2<double>& p) const;
+
+  void build(const std::vector<sf::Vector2<double>>& positions);
+  void build(const std::vector<Boid>& boids);
+
+  int occupiedCells() const { return occupied; }
+  int nodeCount() const { return nodes.size(); }
+  // bytes held by the structure
+  std::size_t bytes() const;
+
+  // the leaves partition the boids; the boids of a leaf are close together
+  int leaves() const { return m_leaves.size(); }
+  const int* leafBegin(int leaf) const {
+    return items.data() + nodes[m_leaves[leaf]].begin;
+  }
+  const int* leafEnd(int leaf) const {
+    return items.data() + nodes[m_leaves[leaf]].end;
+  }
+  int leafSize(int leaf) const {
+    return nodes[m_leaves[leaf]].end - nodes[m_leaves[leaf]].begin;
+  }
+
+  // indices of the boids in the leaves closer than radius to p (periodic
+  // distance), sorted; a superset of the boids within radius.
+  // radius must not exceed the cell size.
+  void candidates(const sf::Vector2<double>& p, double radius,
+                  std::vector<int>& out) const;
+};
+
+}  // namespace bd
+
+#endif
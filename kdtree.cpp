@@ -0,0 +1,121 @@
+#include "kdtree.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <thread>
+
+#include "grid.hpp"
+
+namespace bd {
+
+void KdTree::build(const std::vector<sf::Vector2<double>>& pts, int threads) {
+  points = pts;
+  order.resize(points.size());
+  for (int i = 0, N = order.size(); i < N; ++i) {
+    order[i] = i;
+  }
+  if (threads <= 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  // 2^parallel_depth tasks at the deepest parallel level
+  int parallel_depth = 0;
+  while ((1 << parallel_depth) < threads) ++parallel_depth;
+  build(0, order.size(), 0, parallel_depth);
+}
+
+void KdTree::build(const std::vector<Boid>& boids, int threads) {
+  std::vector<sf::Vector2<double>> pts(boids.size());
+  for (int i = 0, N = boids.size(); i < N; ++i) {
+    pts[i] = boids[i].getPosition();
+  }
+  build(pts, threads);
+}
+
+void KdTree::build(int lo, int hi, int depth, int parallel_depth) {
+  if (hi - lo <= 1) return;
+  const int mid = (lo + hi) / 2;
+  const bool on_x = depth % 2 == 0;
+  std::nth_element(order.begin() + lo, order.begin() + mid, order.begin() + hi,
+                   [this, on_x](int a, int b) {
+                     return on_x ? points[a].x < points[b].x
+                                 : points[a].y < points[b].y;
+                   });
+
+  // small ranges are not worth a task
+  if (depth < parallel_depth && hi - lo > 4096) {
+    auto left = std::async(std::launch::async, [=] {
+      build(lo, mid, depth + 1, parallel_depth);
+    });
+    build(mid + 1, hi, depth + 1, parallel_depth);
+    left.get();
+  } else {
+    build(lo, mid, depth + 1, parallel_depth);
+    build(mid + 1, hi, depth + 1, parallel_depth);
+  }
+}
+
+void KdTree::search(int lo, int hi, int depth, Box box,
+                    const sf::Vector2<double>& q, int k, int exclude,
+                    std::vector<std::pair<double, int>>& heap) const {
+  if (hi <= lo) return;
+  // prune the ranges farther than the current k-th neighbour
+  if (static_cast<int>(heap.size()) == k) {
+    double gx = periodicGap(q.x, box.x0, box.x1, worldWidth);
+    double gy = periodicGap(q.y, box.y0, box.y1, worldHeight);
+    if (gx * gx + gy * gy >= heap.front().first) return;
+  }
+
+  const int mid = (lo + hi) / 2;
+  const int i = order[mid];
+  if (i != exclude) {
+    sf::Vector2<double> r = minimumImage(q, points[i]);
+    double d2 = r.x * r.x + r.y * r.y;
+    if (static_cast<int>(heap.size()) < k) {
+      heap.emplace_back(d2, i);
+      std::push_heap(heap.begin(), heap.end());
+    } else if (d2 < heap.front().first) {
+      std::pop_heap(heap.begin(), heap.end());
+      heap.back() = {d2, i};
+      std::push_heap(heap.begin(), heap.end());
+    }
+  }
+
+  const bool on_x = depth % 2 == 0;
+  const double split = on_x ? points[i].x : points[i].y;
+  Box low = box;
+  Box high = box;
+  if (on_x) {
+    low.x1 = split;
+    high.x0 = split;
+  } else {
+    low.y1 = split;
+    high.y0 = split;
+  }
+  // the side of the query first, so that the other one is pruned more often
+  const bool query_low = (on_x ? q.x : q.y) < split;
+  if (query_low) {
+    search(lo, mid, depth + 1, low, q, k, exclude, heap);
+    search(mid + 1, hi, depth + 1, high, q, k, exclude, heap);
+  } else {
+    search(mid + 1, hi, depth + 1, high, q, k, exclude, heap);
+    search(lo, mid, depth + 1, low, q, k, exclude, heap);
+  }
+}
+
+void KdTree::nearest(const sf::Vector2<double>& q, int k,
+                     std::vector<int>& out, int exclude) const {
+  out.clear();
+  if (k <= 0) return;
+  std::vector<std::pair<double, int>> heap;
+  heap.reserve(k + 1);
+  Box world{0., 0., worldWidth, worldHeight};
+  search(0, order.size(), 0, world, q, k, exclude, heap);
+
+  std::sort_heap(heap.begin(), heap.end());
+  for (const auto& h : heap) {
+    out.push_back(h.second);
+  }
+}
+
+}  // namespace bd
@@ -0,0 +1,44 @@
+#pragma once
+#ifndef KDTREE_HPP
+#define KDTREE_HPP
+
+#include <utility>
+#include <vector>
+
+#include "boid.hpp"
+
+namespace bd {
+
+// 2D tree over the points of the toroidal world, stored implicitly: the
+// median of every range of order is the splitting point, on x at even depth
+// and on y at odd depth. Rebuilt from scratch every step; the upper levels
+// are built by parallel tasks.
+class KdTree {
+  std::vector<sf::Vector2<double>> points;
+  std::vector<int> order;
+
+  void build(int lo, int hi, int depth, int parallel_depth);
+
+  struct Box {
+    double x0, y0, x1, y1;
+  };
+  void search(int lo, int hi, int depth, Box box, const sf::Vector2<double>& q,
+              int k, int exclude,
+              std::vector<std::pair<double, int>>& heap) const;
+
+ public:
+  // threads: upper bound of the build tasks running at once (0: one per core)
+  void build(const std::vector<sf::Vector2<double>>& pts, int threads = 0);
+  void build(const std::vector<Boid>& boids, int threads = 0);
+
+  int size() const { return points.size(); }
+
+  // indices of the k points nearest to q (periodic distance), nearest first,
+  // leaving out the point with index exclude
+  void nearest(const sf::Vector2<double>& q, int k, std::vector<int>& out,
+               int exclude = -1) const;
+};
+
+}  // namespace bd
+
+#endif
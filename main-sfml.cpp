@@ -7,6 +7,8 @@
 #include <vector>
 
 #include "boid.hpp"
+#include "command.hpp"
+#include "fastmath.hpp"
 #include "flock.hpp"
 
 void ignoreLine() {
@@ -99,6 +101,8 @@ int main() {
           r_color.blue = B(eng);
 
           flock1.setColor(r_color);
+          // a long frame must not carry fast boids through each other
+          flock1.setSubsteps(8);
 
           flocks.push_back(flock1);
           std::cout << "Data generated successfully.\n";
@@ -117,6 +121,13 @@ int main() {
           window.setFramerateLimit(60);
 
           sf::Clock clock;
+          std::vector<double> rotations;
+
+          // live tuning without closing the window, e.g.
+          //   echo "s 0.3" > boids.ctl
+          bd::SimulationControl control;
+          bd::ControlEndpoint endpoint(control.queue(), "boids.ctl");
+          std::cout << "Write commands to boids.ctl to control the flocks.\n";
 
           while (window.isOpen()) {
             sf::Event event;
@@ -135,11 +146,19 @@ int main() {
             }
 
             window.clear();
+            control.drain(flocks);
+            const bool running = control.advance();
             for (bd::Flock& flock1 : flocks){
-              flock1.updateFlock(delta_t);
+              if (running) flock1.updateFlock(delta_t);
+
+              // read-only view: drawing leaves the cached observables valid
+              const std::vector<bd::Boid>& boids = flock1.flock();
+              // headings of the whole flock in a single batch:
+              bd::headings(boids, rotations, bd::MathMode::Fast);
 
               // Draw boids on screen:
-              for (const bd::Boid& boid : flock1.flock()) {
+              for (int i = 0; i < flock1.size(); ++i) {
+                const bd::Boid& boid = boids[i];
                 sf::ConvexShape shape;
                 double rotation{};
                 shape.setPosition(boid.getPosition().x, boid.getPosition().y);
@@ -151,7 +170,7 @@ int main() {
                 sf::Color randomColor(flock1.getColor().red, flock1.getColor().green, flock1.getColor().blue);
 
                 shape.setFillColor(randomColor);
-                rotation = bd::angle(boid.getVelocity());
+                rotation = rotations[i];
                 // converting from radians to degrees
                 // with a +270 degrees correction needed because of the window's
                 // origin position
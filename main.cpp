@@ -1,9 +1,15 @@
 #include <iostream>
+#include <memory>
 #include <random>
 #include <stdexcept>
 
 #include "boid.hpp"
+#include "cluster.hpp"
 #include "flock.hpp"
+#include "pipeline.hpp"
+#include "publisher.hpp"
+#include "raster.hpp"
+#include "statistics.hpp"
 
 void ignoreLine() {
   std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
@@ -18,7 +24,6 @@ int main() {
 
     const double duration = 10.0;
     const double delta_t = 1.0;
-    double time{};
 
     std::vector<double> av_distances{};
     std::vector<double> s_distances{};
@@ -29,11 +34,25 @@ int main() {
     double norm{};
     double norm2{};
 
+    // optional file the statistics of every step are streamed to
+    std::string output;
+    // optional frames of the next flocks, drawn every frame_every steps
+    std::string frames;
+    int frame_every{1};
+    // optional shared memory name the next flocks are published to
+    std::string shared;
+
     std::cout
         << "Valid commands: \n"
         << "- generate a flock [g]\n"
         << "- compute statistics and print to screen [s]\n"
         << "- print histograms to screen [h NORM(distance) NORM(speeds)]\n"
+        << "- stream the statistics of the next flocks to a file, in CSV if "
+           "its name ends with .csv [o FILE]\n"
+        << "- render the next flocks every K steps to FILE: numbered .ppm or "
+           ".png frames, or raw rgb24 video for any other name [r FILE K]\n"
+        << "- publish every step of the next flocks to shared memory, for "
+           "boid.watch and other readers [p /NAME]\n"
         << "- quit [q]\n";
 
     sf::VideoMode desktop = sf::VideoMode::getDesktopMode();
@@ -55,8 +74,6 @@ int main() {
         av_speeds.clear();
         s_speeds.clear();
 
-        time = 0.;
-
         std::cout << "Input the parameters: d, ds, s, a, c \n";
 
         std::cin >> par1.d >> par1.ds >> par1.s >> par1.a >> par1.c;
@@ -87,23 +104,74 @@ int main() {
         }
         flock1.setParameters(par1);
 
-        while (time < duration) {
-          double a_d = flock1.average_distance().mean;
-          double s_d = flock1.average_distance().sigma;
-
-          av_distances.push_back(a_d);
-          s_distances.push_back(s_d);
-
-          double a_s = flock1.average_speed().mean;
-          double s_s = flock1.average_speed().sigma;
-
-          av_speeds.push_back(a_s); //average speeds
-          s_speeds.push_back(s_s); //uncertainties 
+        std::unique_ptr<bd::StatisticsSink> sink;
+        flock1.setOrderTracking(!output.empty());
+        if (!shared.empty()) {
+          flock1.setPublisher(
+              std::make_shared<bd::SnapshotPublisher>(shared, flock1.size()));
+        }
+        if (!output.empty()) {
+          bool csv = output.size() > 4 &&
+                     output.compare(output.size() - 4, 4, ".csv") == 0;
+          sink = std::make_unique<bd::StatisticsSink>(
+              output,
+              std::vector<std::string>{"time", "distance_mean",
+                                       "distance_sigma", "speed_mean",
+                                       "speed_sigma", "clusters",
+                                       "polarization", "rotation"},
+              csv ? bd::SinkFormat::Csv : bd::SinkFormat::Binary);
+        }
 
-          flock1.updateFlock(delta_t);
+        std::unique_ptr<bd::Rasterizer> raster;
+        std::unique_ptr<bd::FrameWriter> writer;
+        if (!frames.empty()) {
+          raster = std::make_unique<bd::Rasterizer>(1920, 1080);
+          writer = std::make_unique<bd::FrameWriter>(frames,
+                                                     bd::frameFormat(frames));
+          flock1.setColor({255, 255, 255});
+        }
 
-          time += delta_t;
+        // statistics and output of step t run on their own threads while
+        // step t + 1 is computed
+        bd::PipelinedRunner runner;
+        runner.addStage([&](const bd::Snapshot& s) {
+          const bd::Statistics distance = bd::distanceStatistics(s.positions);
+          const bd::Statistics speed = bd::speedStatistics(s.velocities);
+
+          av_distances.push_back(distance.mean);
+          s_distances.push_back(distance.sigma);
+
+          av_speeds.push_back(speed.mean); //average speeds
+          s_speeds.push_back(speed.sigma); //uncertainties
+
+          if (sink) {
+            double clusters =
+                bd::findClusters(s.positions, s.velocities, par1.d).count();
+            // computed by the previous updateFlock, no extra pass
+            bd::OrderParameters order =
+                s.has_order ? s.order
+                            : bd::orderParameters(s.positions, s.velocities);
+            sink->record({s.time, distance.mean, distance.sigma, speed.mean,
+                          speed.sigma, clusters, order.polarization,
+                          order.rotation});
+          }
+        });
+        if (writer) {
+          runner.addStage([&](const bd::Snapshot& s) {
+            if (s.step % frame_every == 0) {
+              raster->clear();
+              raster->draw(s.positions, s.velocities, s.color);
+              writer->write(*raster);
+            }
+          });
         }
+
+        int steps{};
+        for (double time = 0.; time < duration; time += delta_t) ++steps;
+        runner.run(
+            flock1,
+            [](bd::Flock& flock, double dt) { flock.updateFlock(dt); },
+            steps, delta_t);
         std::cout << "Data generated successfully\n";
       } else if (cmd == 's') {
         if (N == 0) {
@@ -132,6 +200,16 @@ int main() {
                   << "\n";
         bd::histogram(av_speeds, s_speeds, norm2);
 
+      } else if (cmd == 'p' && std::cin >> shared) {
+        std::cout << "Steps will be published to " << shared << "\n";
+      } else if (cmd == 'o' && std::cin >> output) {
+        std::cout << "Statistics will be written to " << output << "\n";
+      } else if (cmd == 'r' && std::cin >> frames >> frame_every) {
+        if (frame_every < 1) {
+          throw std::runtime_error{
+              "Frames can be drawn at most once per step.\n"};
+        }
+        std::cout << "Frames will be written to " << frames << "\n";
       } else if (cmd == 'q') { //exit program
         return EXIT_SUCCESS;
       } else {
@@ -0,0 +1,147 @@
+#include "obstacle.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace bd {
+
+DistanceField::DistanceField(const std::vector<Obstacle>& obstacles,
+                             double resolution) {
+  if (!(resolution > 0.)) {
+    throw std::runtime_error{
+        "Something went wrong. The field resolution must be positive.\n"};
+  }
+  m_columns = std::max(1, static_cast<int>(std::ceil(worldWidth / resolution)));
+  m_rows = std::max(1, static_cast<int>(std::ceil(worldHeight / resolution)));
+  // nodes are evenly spread, so that the grid closes on itself
+  m_resolution = worldWidth / m_columns;
+
+  phi.assign(m_columns * m_rows, std::numeric_limits<double>::max());
+  const double hy = worldHeight / m_rows;
+  for (int y = 0; y < m_rows; ++y) {
+    for (int x = 0; x < m_columns; ++x) {
+      sf::Vector2<double> p(x * m_resolution, y * hy);
+      double& value = phi[y * m_columns + x];
+      for (const Obstacle& o : obstacles) {
+        value = std::min(value, magnitude(minimumImage(o.centre, p)) - o.radius);
+      }
+    }
+  }
+}
+
+double DistanceField::node(int x, int y) const {
+  x = ((x % m_columns) + m_columns) % m_columns;
+  y = ((y % m_rows) + m_rows) % m_rows;
+  return phi[y * m_columns + x];
+}
+
+double DistanceField::sample(const sf::Vector2<double>& p) const {
+  const double fx = wrapPosition(p).x / worldWidth * m_columns;
+  const double fy = wrapPosition(p).y / worldHeight * m_rows;
+  const int x = static_cast<int>(fx);
+  const int y = static_cast<int>(fy);
+  const double tx = fx - x;
+  const double ty = fy - y;
+  return (1 - ty) * ((1 - tx) * node(x, y) + tx * node(x + 1, y)) +
+         ty * ((1 - tx) * node(x, y + 1) + tx * node(x + 1, y + 1));
+}
+
+sf::Vector2<double> DistanceField::gradient(const sf::Vector2<double>& p) const {
+  const double fx = wrapPosition(p).x / worldWidth * m_columns;
+  const double fy = wrapPosition(p).y / worldHeight * m_rows;
+  const int x = static_cast<int>(fx);
+  const int y = static_cast<int>(fy);
+  const double tx = fx - x;
+  const double ty = fy - y;
+  const double p00 = node(x, y);
+  const double p10 = node(x + 1, y);
+  const double p01 = node(x, y + 1);
+  const double p11 = node(x + 1, y + 1);
+  const double hx = worldWidth / m_columns;
+  const double hy = worldHeight / m_rows;
+  return {((1 - ty) * (p10 - p00) + ty * (p11 - p01)) / hx,
+          ((1 - tx) * (p01 - p00) + tx * (p11 - p10)) / hy};
+}
+
+Environment::Environment(double radius)
+    : predator_grid(radius > 0. ? radius : 1.), flee_radius(radius) {
+  if (!(radius > 0.)) {
+    throw std::runtime_error{
+        "Something went wrong. The flee radius must be positive.\n"};
+  }
+}
+
+void Environment::setObstacles(std::shared_ptr<const DistanceField> f,
+                               double m, double strength) {
+  field = std::move(f);
+  margin = m;
+  avoidance = strength;
+}
+
+void Environment::addPredator(const Boid& predator) {
+  m_predators.push_back(predator);
+  predator_grid.build(m_predators);
+}
+
+void Environment::update(const std::vector<Boid>& prey,
+                         double const delta_t) {
+  if (m_predators.empty()) return;
+  for (Boid& predator : m_predators) {
+    // a handful of predators: a linear search of the prey is enough
+    double best = std::numeric_limits<double>::max();
+    sf::Vector2<double> target;
+    for (const Boid& boid : prey) {
+      sf::Vector2<double> delta =
+          minimumImage(predator.getPosition(), boid.getPosition());
+      double d2 = delta.x * delta.x + delta.y * delta.y;
+      if (d2 < best) {
+        best = d2;
+        target = delta;
+      }
+    }
+    if (predator_speed > 0. && best > 0. &&
+        best < std::numeric_limits<double>::max()) {
+      predator.setVelocity(target * (predator_speed / std::sqrt(best)));
+    }
+    predator.updatePosition(delta_t);
+    predator.borders();
+  }
+  predator_grid.build(m_predators);
+}
+
+sf::Vector2<double> Environment::steering(const Boid& boid) const {
+  sf::Vector2<double> dv(0, 0);
+  const sf::Vector2<double> p = boid.getPosition();
+
+  if (field) {
+    double distance1 = field->sample(p);
+    if (distance1 < margin) {
+      sf::Vector2<double> g = field->gradient(p);
+      double norm = magnitude(g);
+      if (norm > 0.) {
+        dv += g * (avoidance * (margin - distance1) / norm);
+      }
+    }
+  }
+
+  if (!m_predators.empty() && flee > 0.) {
+    int around[9];
+    int n = predator_grid.neighbourCells(predator_grid.cellOf(p), around);
+    for (int k = 0; k < n; ++k) {
+      for (const int* i = predator_grid.cellBegin(around[k]);
+           i != predator_grid.cellEnd(around[k]); ++i) {
+        sf::Vector2<double> away =
+            minimumImage(m_predators[*i].getPosition(), p);
+        double distance1 = magnitude(away);
+        if (distance1 > 0. && distance1 < flee_radius) {
+          dv += away * (flee * (1. - distance1 / flee_radius) / distance1);
+        }
+      }
+    }
+  }
+  return dv;
+}
+
+}  // namespace bd
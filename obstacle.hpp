@@ -0,0 +1,78 @@
+#pragma once
+#ifndef OBSTACLE_HPP
+#define OBSTACLE_HPP
+
+#include <memory>
+#include <vector>
+
+#include "boid.hpp"
+#include "grid.hpp"
+
+namespace bd {
+
+// static circular obstacle
+struct Obstacle {
+  sf::Vector2<double> centre;
+  double radius{};
+};
+
+// signed distance from the nearest obstacle (negative inside) sampled on a
+// periodic grid of nodes spaced resolution apart. Built once in
+// O(nodes * obstacles), then every lookup is a bilinear interpolation of four
+// nodes, whatever the number of obstacles.
+class DistanceField {
+  double m_resolution{};
+  int m_columns{};
+  int m_rows{};
+  std::vector<double> phi;
+
+  double node(int x, int y) const;
+
+ public:
+  DistanceField(const std::vector<Obstacle>& obstacles, double resolution);
+
+  double resolution() const { return m_resolution; }
+
+  double sample(const sf::Vector2<double>& p) const;
+  // gradient of the interpolated field, pointing away from the obstacles
+  sf::Vector2<double> gradient(const sf::Vector2<double>& p) const;
+};
+
+// everything a boid reacts to besides the other boids of its flock
+class Environment {
+  std::shared_ptr<const DistanceField> field;
+  double margin{};
+  double avoidance{};
+
+  std::vector<Boid> m_predators;
+  SpatialGrid predator_grid;
+  double flee_radius{};
+  double flee{};
+  double predator_speed{};
+
+ public:
+  // boids closer than flee_radius to a predator run away from it
+  explicit Environment(double flee_radius = 100.);
+
+  // boids closer than margin to an obstacle are pushed along the gradient of
+  // the field, with strength proportional to how deep they are
+  void setObstacles(std::shared_ptr<const DistanceField> f, double margin,
+                    double strength);
+
+  // predators are kept in their own spatial grid, separate from the flock
+  void addPredator(const Boid& predator);
+  const std::vector<Boid>& predators() const { return m_predators; }
+  void setFlee(double strength) { flee = strength; }
+  void setPredatorSpeed(double speed) { predator_speed = speed; }
+
+  // moves every predator towards the nearest prey and rebuilds their grid,
+  // once per step before the boids are updated
+  void update(const std::vector<Boid>& prey, double const delta_t);
+
+  // steering of a boid away from obstacles and predators
+  sf::Vector2<double> steering(const Boid& boid) const;
+};
+
+}  // namespace bd
+
+#endif
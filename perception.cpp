@@ -0,0 +1,79 @@
+#include "perception.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "grid.hpp"
+
+namespace bd {
+
+Perception Perception::cone(double degrees, int max_neighbours) {
+  if (degrees <= 0. || degrees > 360.) {
+    throw std::runtime_error{
+        "Something went wrong. The field of view must be between 0 and 360 "
+        "degrees.\n"};
+  }
+  if (max_neighbours < 0) {
+    throw std::runtime_error{
+        "Something went wrong. The number of neighbours must be positive.\n"};
+  }
+  return {std::cos(degrees / 2 * M_PI / 180), max_neighbours};
+}
+
+bool Perception::sees(const sf::Vector2<double>& v,
+                      const sf::Vector2<double>& r) const {
+  // r.v >= cos |r| |v|, squared with care for the signs
+  const double dot = r.x * v.x + r.y * v.y;
+  const double c2 = cos_half_angle * cos_half_angle;
+  const double norms = (r.x * r.x + r.y * r.y) * (v.x * v.x + v.y * v.y);
+  if (cos_half_angle >= 0.) {
+    return dot >= 0. && dot * dot >= c2 * norms;
+  }
+  return dot >= 0. || dot * dot <= c2 * norms;
+}
+
+void visibleNeighbours(int self, const std::vector<Boid>& boids,
+                       const std::vector<int>& candidates, double radius,
+                       const Perception& perception, std::vector<int>& out) {
+  const sf::Vector2<double> p = boids[self].getPosition();
+  const sf::Vector2<double> v = boids[self].getVelocity();
+  const double r2 = radius * radius;
+  auto offset2 = [&](int j) {
+    const sf::Vector2<double> r = minimumImage(p, boids[j].getPosition());
+    return r.x * r.x + r.y * r.y;
+  };
+
+  out.clear();
+  for (int j : candidates) {
+    if (j == self) continue;
+    const sf::Vector2<double> r = minimumImage(p, boids[j].getPosition());
+    if (r.x * r.x + r.y * r.y >= r2) continue;
+    if (!perception.sees(v, r)) continue;
+    out.push_back(j);
+  }
+
+  const int k = perception.max_neighbours;
+  const bool capped = k > 0 && static_cast<int>(out.size()) > k;
+  if (capped) {
+    std::nth_element(out.begin(), out.begin() + k, out.end(),
+                     [&](int a, int b) {
+                       const double da = offset2(a);
+                       const double db = offset2(b);
+                       return da < db || (da == db && a < b);
+                     });
+    out.resize(k);
+  }
+
+  // the boid itself always counts, as in the rules over the whole flock
+  out.push_back(self);
+  if (capped) {
+    std::sort(out.begin(), out.end());
+  } else {
+    // the candidates were sorted: only self has to move into place
+    std::rotate(std::lower_bound(out.begin(), out.end() - 1, self),
+                out.end() - 1, out.end());
+  }
+}
+
+}  // namespace bd
@@ -0,0 +1,39 @@
+#pragma once
+#ifndef PERCEPTION_HPP
+#define PERCEPTION_HPP
+
+#include <vector>
+
+#include "boid.hpp"
+
+namespace bd {
+
+// what a boid can see: the boids inside a cone around its velocity and, if
+// max_neighbours > 0, only the nearest max_neighbours of them
+struct Perception {
+  double cos_half_angle{-1.};  // -1: all around
+  int max_neighbours{};        // 0: no limit
+
+  // cone of the given total opening in degrees
+  static Perception cone(double degrees, int max_neighbours = 0);
+
+  bool isActive() const { return cos_half_angle > -1. || max_neighbours > 0; }
+
+  // true if a boid at offset r from an observer moving with velocity v lies
+  // inside the cone. Compares the dot product with the squared norms, so no
+  // square root or arctangent is needed; a still boid sees everything.
+  bool sees(const sf::Vector2<double>& v, const sf::Vector2<double>& r) const;
+};
+
+// the boids of candidates (indices into boids, sorted) that boids[self] sees
+// within radius, itself included. Their indices are written to out in
+// increasing order, so that the rules sum them in the same order as they
+// would over the whole flock; out is reused from call to call and no boid
+// is copied.
+void visibleNeighbours(int self, const std::vector<Boid>& boids,
+                       const std::vector<int>& candidates, double radius,
+                       const Perception& perception, std::vector<int>& out);
+
+}  // namespace bd
+
+#endif
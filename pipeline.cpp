@@ -0,0 +1,134 @@
+#include "pipeline.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace bd {
+
+namespace {
+// bounded queue of snapshots feeding a stage
+struct StageQueue {
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::shared_ptr<const Snapshot>> items;
+  bool closed{};
+};
+}  // namespace
+
+PipelinedRunner::PipelinedRunner(int capacity_) : capacity{capacity_} {
+  if (capacity < 1) {
+    throw std::runtime_error{
+        "Something went wrong. A stage must hold at least one snapshot.\n"};
+  }
+}
+
+void PipelinedRunner::addStage(Stage stage) {
+  stages.push_back(std::move(stage));
+}
+
+std::shared_ptr<Snapshot> PipelinedRunner::take() {
+  // only the pool holds it: no stage can get it back
+  for (auto& s : pool) {
+    if (s.use_count() == 1) return s;
+  }
+  pool.push_back(std::make_shared<Snapshot>());
+  return pool.back();
+}
+
+void PipelinedRunner::run(Flock& flock, const Engine& engine, int steps,
+                          double delta_t) {
+  const int S = stages.size();
+  std::vector<StageQueue> queues(S);
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  bool failed = false;
+
+  std::vector<std::thread> workers;
+  for (int k = 0; k < S; ++k) {
+    workers.emplace_back([&, k] {
+      StageQueue& q = queues[k];
+      while (true) {
+        std::shared_ptr<const Snapshot> snapshot;
+        {
+          std::unique_lock<std::mutex> lock(q.mutex);
+          q.changed.wait(lock, [&q] { return q.closed || !q.items.empty(); });
+          if (q.items.empty()) return;
+          snapshot = std::move(q.items.front());
+          q.items.pop_front();
+        }
+        q.changed.notify_all();
+        try {
+          stages[k](*snapshot);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(error_mutex);
+          if (!error) error = std::current_exception();
+          failed = true;
+        }
+        snapshot.reset();
+        {
+          std::lock_guard<std::mutex> lock(error_mutex);
+          if (failed) break;
+        }
+      }
+      // wake the engine if it waits for this stage
+      std::lock_guard<std::mutex> lock(q.mutex);
+      q.closed = true;
+      q.items.clear();
+      q.changed.notify_all();
+    });
+  }
+
+  auto stop = [&] {
+    for (auto& q : queues) {
+      std::lock_guard<std::mutex> lock(q.mutex);
+      q.closed = true;
+      q.changed.notify_all();
+    }
+    for (auto& t : workers) t.join();
+  };
+
+  try {
+    double time = 0.;
+    for (int step = 0; step < steps; ++step) {
+      if (S > 0) {
+        std::shared_ptr<Snapshot> snapshot = take();
+        snapshot->step = step;
+        snapshot->time = time;
+        const std::vector<Boid>& boids = flock.flock();
+        const int n = boids.size();
+        snapshot->positions.resize(n);
+        snapshot->velocities.resize(n);
+        for (int i = 0; i < n; ++i) {
+          snapshot->positions[i] = boids[i].getPosition();
+          snapshot->velocities[i] = boids[i].getVelocity();
+        }
+        snapshot->color = flock.getColor();
+        snapshot->has_order = flock.orderTracking();
+        if (snapshot->has_order) snapshot->order = flock.orderParameters();
+        for (auto& q : queues) {
+          std::unique_lock<std::mutex> lock(q.mutex);
+          q.changed.wait(lock, [&] {
+            return q.closed || static_cast<int>(q.items.size()) < capacity;
+          });
+          if (!q.closed) q.items.push_back(snapshot);
+          q.changed.notify_all();
+        }
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (failed) break;
+      }
+      engine(flock, delta_t);
+      time += delta_t;
+    }
+  } catch (...) {
+    stop();
+    throw;
+  }
+  stop();
+  if (error) std::rethrow_exception(error);
+}
+
+}  // namespace bd
@@ -0,0 +1,65 @@
+#pragma once
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "flock.hpp"
+#include "replay.hpp"
+
+namespace bd {
+
+// the state of the flock at the start of a step, as the stages see it: only
+// the boids, without the caches, scheduler or publisher of the Flock
+struct Snapshot {
+  int step{};
+  double time{};
+  std::vector<sf::Vector2<double>> positions;
+  std::vector<sf::Vector2<double>> velocities;
+  Color color;
+  // copied only from a flock tracking them, which has them for free
+  bool has_order{};
+  OrderParameters order;
+
+  int size() const { return positions.size(); }
+};
+
+// Overlaps the simulation with what is done with its results: after every
+// step a copy of the flock goes to each stage, which runs on its own thread
+// and gets the snapshots in order, while the engine already computes the
+// next step. A stage falling behind holds at most capacity snapshots; then
+// the engine waits for it. The time per step becomes the largest of the
+// costs of the engine and the stages instead of their sum.
+//
+// Stages read the same snapshot at the same time and must not change it; the
+// free functions distanceStatistics, speedStatistics and orderParameters of
+// flock.hpp compute the observables from it.
+class PipelinedRunner {
+ public:
+  using Stage = std::function<void(const Snapshot&)>;
+
+ private:
+  int capacity{};
+  std::vector<Stage> stages;
+  // snapshots are recycled once no stage holds them any more, so the boids
+  // are copied into arrays that are already allocated
+  std::vector<std::shared_ptr<Snapshot>> pool;
+
+  std::shared_ptr<Snapshot> take();
+
+ public:
+  explicit PipelinedRunner(int capacity = 2);
+
+  void addStage(Stage stage);
+
+  // hands the states at step 0 .. steps - 1 to the stages and advances the
+  // flock by steps steps of delta_t with engine. Rethrows the first
+  // exception of a stage, after stopping the others.
+  void run(Flock& flock, const Engine& engine, int steps, double delta_t);
+};
+
+}  // namespace bd
+
+#endif
@@ -0,0 +1,104 @@
+#include "publisher.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <stdexcept>
+
+namespace bd {
+
+SnapshotPublisher::SnapshotPublisher(const std::string& name, int capacity,
+                                     int slots)
+    : m_name{name} {
+  if (name.size() < 2 || name[0] != '/' ||
+      name.find('/', 1) != std::string::npos) {
+    throw std::runtime_error{
+        "Something went wrong. Shared memory names look like /name.\n"};
+  }
+  if (capacity < 0 || slots < 1) {
+    throw std::runtime_error{
+        "Something went wrong. The publisher needs a positive capacity and "
+        "at least one slot.\n"};
+  }
+  bytes = shmBytes(capacity, slots);
+
+  ::shm_unlink(name.c_str());
+  const int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    throw std::runtime_error{"Could not create " + name + "."};
+  }
+  if (::ftruncate(fd, bytes) != 0) {
+    ::close(fd);
+    ::shm_unlink(name.c_str());
+    throw std::runtime_error{"Could not size " + name + "."};
+  }
+  void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    ::shm_unlink(name.c_str());
+    throw std::runtime_error{"Could not map " + name + "."};
+  }
+  base = static_cast<unsigned char*>(p);
+
+  // the new object is zeroed: sequences and frame count start at 0
+  ShmHeader& h = header();
+  h.version = shmVersion;
+  h.slots = slots;
+  h.capacity = capacity;
+  h.published.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(h.magic, "BOIDSHM1", 8);
+}
+
+SnapshotPublisher::~SnapshotPublisher() {
+  ::munmap(base, bytes);
+  ::shm_unlink(m_name.c_str());
+}
+
+std::uint64_t SnapshotPublisher::published() const {
+  return reinterpret_cast<const ShmHeader*>(base)->published.load(
+      std::memory_order_relaxed);
+}
+
+void SnapshotPublisher::publish(const Flock& flock) {
+  ShmHeader& h = header();
+  const std::uint64_t count = flock.size();
+  if (count > h.capacity) {
+    throw std::runtime_error{
+        "Something went wrong. The flock is larger than the shared memory "
+        "capacity.\n"};
+  }
+  const std::uint64_t f = h.published.load(std::memory_order_relaxed);
+  unsigned char* slot =
+      base + sizeof(ShmHeader) + (f % h.slots) * shmSlotBytes(h.capacity);
+  SlotHeader& s = *reinterpret_cast<SlotHeader*>(slot);
+
+  // odd: readers of this slot retry or discard what they copy
+  const std::uint64_t sequence = s.sequence.load(std::memory_order_relaxed);
+  s.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  s.frame = f;
+  s.generation = flock.generation();
+  s.count = count;
+  double* x = reinterpret_cast<double*>(slot + sizeof(SlotHeader));
+  double* y = x + h.capacity;
+  double* vx = y + h.capacity;
+  double* vy = vx + h.capacity;
+  const auto& boids = flock.flock();
+  for (std::uint64_t i = 0; i < count; ++i) {
+    const sf::Vector2<double> p = boids[i].getPosition();
+    const sf::Vector2<double> v = boids[i].getVelocity();
+    x[i] = p.x;
+    y[i] = p.y;
+    vx[i] = v.x;
+    vy[i] = v.y;
+  }
+
+  s.sequence.store(sequence + 2, std::memory_order_release);
+  h.published.store(f + 1, std::memory_order_release);
+}
+
+}  // namespace bd
@@ -0,0 +1,44 @@
+#pragma once
+#ifndef PUBLISHER_HPP
+#define PUBLISHER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "flock.hpp"
+#include "shm.hpp"
+
+namespace bd {
+
+// Writes the positions and velocities of a flock, as plain arrays, into a
+// POSIX shared memory ring that SnapshotReader (shm.hpp) reads from other
+// processes. Publishing is a copy into the mapping: no serialization, no
+// system call, no waiting for the readers.
+class SnapshotPublisher {
+  std::string m_name;
+  unsigned char* base{};
+  std::size_t bytes{};
+
+  ShmHeader& header() { return *reinterpret_cast<ShmHeader*>(base); }
+
+ public:
+  // name: "/something"; capacity: largest flock that will be published;
+  // slots: frames kept, so that a slow reader still finds a whole one.
+  // An object left with the same name by an earlier run is replaced.
+  SnapshotPublisher(const std::string& name, int capacity, int slots = 4);
+  SnapshotPublisher(const SnapshotPublisher&) = delete;
+  SnapshotPublisher& operator=(const SnapshotPublisher&) = delete;
+  // removes the name; readers already attached keep their mapping
+  ~SnapshotPublisher();
+
+  const std::string& name() const { return m_name; }
+  std::uint64_t published() const;
+
+  // throws if the flock is larger than the capacity
+  void publish(const Flock& flock);
+};
+
+}  // namespace bd
+
+#endif
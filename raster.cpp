@@ -0,0 +1,373 @@
+#include "raster.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+
+#include "fastmath.hpp"
+
+namespace bd {
+
+Rasterizer::Rasterizer(int width, int height, int threads_, int tile_)
+    : m_width{width}, m_height{height}, threads{threads_}, tile{tile_} {
+  if (width <= 0 || height <= 0 || tile <= 0) {
+    throw std::runtime_error{
+        "Something went wrong. The frame and its tiles must not be empty.\n"};
+  }
+  if (threads <= 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  tiles_x = (width + tile - 1) / tile;
+  tiles_y = (height + tile - 1) / tile;
+  m_pixels.resize(3 * width * height);
+}
+
+void Rasterizer::clear(const Color& background) {
+  const std::uint8_t rgb[3] = {static_cast<std::uint8_t>(background.red),
+                               static_cast<std::uint8_t>(background.green),
+                               static_cast<std::uint8_t>(background.blue)};
+  for (std::size_t i = 0; i < m_pixels.size(); i += 3) {
+    m_pixels[i] = rgb[0];
+    m_pixels[i + 1] = rgb[1];
+    m_pixels[i + 2] = rgb[2];
+  }
+}
+
+void Rasterizer::draw(const Flock& flock, double side) {
+  const auto& boids = flock.flock();
+  std::vector<sf::Vector2<double>> positions(boids.size());
+  std::vector<sf::Vector2<double>> velocities(boids.size());
+  for (int i = 0, n = boids.size(); i < n; ++i) {
+    positions[i] = boids[i].getPosition();
+    velocities[i] = boids[i].getVelocity();
+  }
+  draw(positions, velocities, flock.getColor(), side);
+}
+
+void Rasterizer::draw(const std::vector<sf::Vector2<double>>& positions,
+                      const std::vector<sf::Vector2<double>>& velocities,
+                      const Color& color, double side) {
+  const int n = positions.size();
+  if (n == 0) return;
+
+  // the heading of the viewer, and its shape (-s, s), (s, s), (0, 5s)
+  // rotated by 270 degrees + heading: a local point (px, py) lands at
+  // (px sin r + py cos r, -px cos r + py sin r)
+  vx.resize(n);
+  vy.resize(n);
+  for (int i = 0; i < n; ++i) {
+    vx[i] = velocities[i].x;
+    vy[i] = velocities[i].y;
+  }
+  rotations.resize(n);
+  angles(vx.data(), vy.data(), rotations.data(), n, MathMode::Fast);
+  const double sx = m_width / worldWidth;
+  const double sy = m_height / worldHeight;
+  const std::array<std::array<double, 2>, 3> shape{
+      {{-side, side}, {side, side}, {0., 5 * side}}};
+  vertices.resize(6 * n);
+  for (int i = 0; i < n; ++i) {
+    const double c = std::cos(rotations[i]);
+    const double s = std::sin(rotations[i]);
+    const sf::Vector2<double> p = positions[i];
+    double* v = vertices.data() + 6 * i;
+    for (int k = 0; k < 3; ++k) {
+      const double px = shape[k][0];
+      const double py = shape[k][1];
+      v[2 * k] = (p.x + px * s + py * c) * sx;
+      v[2 * k + 1] = (p.y - px * c + py * s) * sy;
+    }
+  }
+
+  bin(n);
+
+  const std::uint8_t rgb[3] = {static_cast<std::uint8_t>(color.red),
+                               static_cast<std::uint8_t>(color.green),
+                               static_cast<std::uint8_t>(color.blue)};
+  const int T = tiles_x * tiles_y;
+  std::atomic<int> next{0};
+  auto work = [&] {
+    for (int t = next++; t < T; t = next++) {
+      fillTile(t, rgb);
+    }
+  };
+  const int workers_n = std::min(threads, T);
+  std::vector<std::thread> workers;
+  for (int w = 1; w < workers_n; ++w) {
+    workers.emplace_back(work);
+  }
+  work();
+  for (auto& w : workers) {
+    w.join();
+  }
+}
+
+// tiles covered by the bounding box of triangle i, clipped to the frame;
+// false if it lies outside
+static bool tileRange(const double* v, int tile, int tiles_x, int tiles_y,
+                      int& x0, int& y0, int& x1, int& y1) {
+  const double min_x = std::min({v[0], v[2], v[4]});
+  const double max_x = std::max({v[0], v[2], v[4]});
+  const double min_y = std::min({v[1], v[3], v[5]});
+  const double max_y = std::max({v[1], v[3], v[5]});
+  x0 = std::max(0, static_cast<int>(std::floor(min_x)) / tile);
+  y0 = std::max(0, static_cast<int>(std::floor(min_y)) / tile);
+  x1 = std::min(tiles_x - 1, static_cast<int>(std::floor(max_x)) / tile);
+  y1 = std::min(tiles_y - 1, static_cast<int>(std::floor(max_y)) / tile);
+  return max_x >= 0. && max_y >= 0. && x0 <= x1 && y0 <= y1;
+}
+
+// counting sort of the triangles by tile, as SpatialGrid does with the boids:
+// the triangles of a tile stay in the order of the boids
+void Rasterizer::bin(int n) {
+  const int T = tiles_x * tiles_y;
+  tile_start.assign(T + 1, 0);
+  int x0, y0, x1, y1;
+  for (int i = 0; i < n; ++i) {
+    if (!tileRange(vertices.data() + 6 * i, tile, tiles_x, tiles_y, x0, y0,
+                   x1, y1)) {
+      continue;
+    }
+    for (int ty = y0; ty <= y1; ++ty) {
+      for (int tx = x0; tx <= x1; ++tx) {
+        ++tile_start[ty * tiles_x + tx + 1];
+      }
+    }
+  }
+  for (int t = 0; t < T; ++t) {
+    tile_start[t + 1] += tile_start[t];
+  }
+  tile_items.resize(tile_start[T]);
+  std::vector<int> fill(tile_start.begin(), tile_start.end() - 1);
+  for (int i = 0; i < n; ++i) {
+    if (!tileRange(vertices.data() + 6 * i, tile, tiles_x, tiles_y, x0, y0,
+                   x1, y1)) {
+      continue;
+    }
+    for (int ty = y0; ty <= y1; ++ty) {
+      for (int tx = x0; tx <= x1; ++tx) {
+        tile_items[fill[ty * tiles_x + tx]++] = i;
+      }
+    }
+  }
+}
+
+// a pixel is filled if its centre lies inside the triangle (edge functions)
+void Rasterizer::fillTile(int t, const std::uint8_t rgb[3]) {
+  const int tx0 = (t % tiles_x) * tile;
+  const int ty0 = (t / tiles_x) * tile;
+  const int tx1 = std::min(tx0 + tile, m_width);
+  const int ty1 = std::min(ty0 + tile, m_height);
+
+  for (int item = tile_start[t]; item < tile_start[t + 1]; ++item) {
+    const double* v = vertices.data() + 6 * tile_items[item];
+    double ax = v[0], ay = v[1], bx = v[2], by = v[3], cx = v[4], cy = v[5];
+    // counter-clockwise, so that inside means all edges positive
+    if ((bx - ax) * (cy - ay) - (by - ay) * (cx - ax) < 0.) {
+      std::swap(bx, cx);
+      std::swap(by, cy);
+    }
+    const int x0 = std::max(tx0, static_cast<int>(std::floor(
+                                     std::min({ax, bx, cx}))));
+    const int x1 = std::min(tx1 - 1, static_cast<int>(std::floor(
+                                         std::max({ax, bx, cx}))));
+    const int y0 = std::max(ty0, static_cast<int>(std::floor(
+                                     std::min({ay, by, cy}))));
+    const int y1 = std::min(ty1 - 1, static_cast<int>(std::floor(
+                                         std::max({ay, by, cy}))));
+
+    // along a row every edge function is linear in x, so the pixels inside
+    // form a span found from the three edges, without testing every pixel
+    const double k[3] = {-(by - ay), -(cy - by), -(ay - cy)};
+    const double inv[3] = {k[0] != 0. ? 1 / k[0] : 0.,
+                           k[1] != 0. ? 1 / k[1] : 0.,
+                           k[2] != 0. ? 1 / k[2] : 0.};
+    for (int y = y0; y <= y1; ++y) {
+      const double py = y + 0.5;
+      const double px = x0 + 0.5;
+      const double e[3] = {(bx - ax) * (py - ay) - (by - ay) * (px - ax),
+                           (cx - bx) * (py - by) - (cy - by) * (px - bx),
+                           (ax - cx) * (py - cy) - (ay - cy) * (px - cx)};
+      double lo = x0;
+      double hi = x1;
+      for (int j = 0; j < 3; ++j) {
+        if (k[j] > 0.) {
+          lo = std::max(lo, x0 + std::ceil(-e[j] * inv[j]));
+        } else if (k[j] < 0.) {
+          hi = std::min(hi, x0 + std::floor(-e[j] * inv[j]));
+        } else if (e[j] < 0.) {
+          hi = lo - 1;
+        }
+      }
+      std::uint8_t* p = m_pixels.data() + 3 * (y * m_width);
+      for (int x = lo, end = hi; x <= end; ++x) {
+        p[3 * x] = rgb[0];
+        p[3 * x + 1] = rgb[1];
+        p[3 * x + 2] = rgb[2];
+      }
+    }
+  }
+}
+
+FrameFormat frameFormat(const std::string& path) {
+  auto ends = [&path](const std::string& ext) {
+    return path.size() > ext.size() &&
+           path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+  };
+  if (ends(".ppm")) return FrameFormat::Ppm;
+  if (ends(".png")) return FrameFormat::Png;
+  return FrameFormat::Raw;
+}
+
+static std::FILE* openFrame(const std::string& path) {
+  std::FILE* file = std::fopen(path.c_str(), "wb");
+  if (!file) {
+    throw std::runtime_error{"Could not open " + path + "."};
+  }
+  return file;
+}
+
+void writePpm(const std::string& path, const Rasterizer& frame) {
+  std::FILE* file = openFrame(path);
+  const auto& pixels = frame.pixels();
+  bool ok = std::fprintf(file, "P6\n%d %d\n255\n", frame.width(),
+                         frame.height()) > 0 &&
+            std::fwrite(pixels.data(), 1, pixels.size(), file) ==
+                pixels.size();
+  // a full disk may show up only when the buffer is flushed
+  ok = std::fclose(file) == 0 && ok;
+  if (!ok) {
+    throw std::runtime_error{"Could not write " + path + "."};
+  }
+}
+
+namespace {
+std::uint32_t crc32(const std::uint8_t* data, std::size_t n,
+                    std::uint32_t crc = 0) {
+  static const auto table = [] {
+    std::array<std::uint32_t, 256> t{};
+    for (std::uint32_t i = 0; i < 256; ++i) {
+      std::uint32_t c = i;
+      for (int k = 0; k < 8; ++k) {
+        c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      }
+      t[i] = c;
+    }
+    return t;
+  }();
+  crc = ~crc;
+  for (std::size_t i = 0; i < n; ++i) {
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+void putBig(std::vector<std::uint8_t>& out, std::uint32_t x) {
+  out.insert(out.end(), {static_cast<std::uint8_t>(x >> 24),
+                         static_cast<std::uint8_t>(x >> 16),
+                         static_cast<std::uint8_t>(x >> 8),
+                         static_cast<std::uint8_t>(x)});
+}
+
+// true if the whole chunk was written
+bool putChunk(std::FILE* file, const char type[4],
+              const std::vector<std::uint8_t>& data) {
+  std::vector<std::uint8_t> chunk;
+  putBig(chunk, data.size());
+  chunk.insert(chunk.end(), type, type + 4);
+  chunk.insert(chunk.end(), data.begin(), data.end());
+  putBig(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+  return std::fwrite(chunk.data(), 1, chunk.size(), file) == chunk.size();
+}
+}  // namespace
+
+void writePng(const std::string& path, const Rasterizer& frame) {
+  const int w = frame.width();
+  const int h = frame.height();
+  const std::uint8_t* pixels = frame.pixels().data();
+
+  std::vector<std::uint8_t> header;
+  putBig(header, w);
+  putBig(header, h);
+  header.insert(header.end(), {8, 2, 0, 0, 0});  // 8 bit RGB
+
+  // rows with filter type 0, in a zlib stream of stored blocks
+  const std::size_t row = 3 * w;
+  const std::size_t raw = (row + 1) * h;
+  std::vector<std::uint8_t> data{0x78, 0x01};
+  data.reserve(raw + raw / 65535 * 5 + 16);
+  std::uint32_t a = 1, b = 0;  // Adler-32
+  std::size_t done = 0;
+  while (done < raw) {
+    const std::size_t n = std::min<std::size_t>(65535, raw - done);
+    data.push_back(done + n == raw ? 1 : 0);
+    data.insert(data.end(), {static_cast<std::uint8_t>(n),
+                             static_cast<std::uint8_t>(n >> 8),
+                             static_cast<std::uint8_t>(~n),
+                             static_cast<std::uint8_t>(~n >> 8)});
+    for (std::size_t i = done; i < done + n; ++i) {
+      const std::size_t r = i / (row + 1);
+      const std::size_t c = i % (row + 1);
+      const std::uint8_t byte = c == 0 ? 0 : pixels[r * row + c - 1];
+      data.push_back(byte);
+      a = (a + byte) % 65521;
+      b = (b + a) % 65521;
+    }
+    done += n;
+  }
+  putBig(data, b << 16 | a);
+
+  std::FILE* file = openFrame(path);
+  const std::uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a,
+                                     '\n'};
+  bool ok = std::fwrite(signature, 1, sizeof(signature), file) ==
+                sizeof(signature) &&
+            putChunk(file, "IHDR", header) && putChunk(file, "IDAT", data) &&
+            putChunk(file, "IEND", {});
+  ok = std::fclose(file) == 0 && ok;
+  if (!ok) {
+    throw std::runtime_error{"Could not write " + path + "."};
+  }
+}
+
+FrameWriter::FrameWriter(std::string path_, FrameFormat format_)
+    : path{std::move(path_)}, format{format_} {
+  if (format == FrameFormat::Raw) {
+    stream = path == "-" ? stdout : openFrame(path);
+  }
+}
+
+FrameWriter::~FrameWriter() {
+  if (stream && stream != stdout) {
+    std::fclose(stream);
+  } else if (stream) {
+    std::fflush(stream);
+  }
+}
+
+void FrameWriter::write(const Rasterizer& frame) {
+  if (format == FrameFormat::Raw) {
+    const auto& pixels = frame.pixels();
+    if (std::fwrite(pixels.data(), 1, pixels.size(), stream) !=
+        pixels.size()) {
+      throw std::runtime_error{"Could not write " + path + "."};
+    }
+  } else {
+    char number[16];
+    std::snprintf(number, sizeof(number), "%05d", m_frames);
+    auto dot = path.rfind('.');
+    if (dot == std::string::npos) dot = path.size();
+    const std::string name = path.substr(0, dot) + number + path.substr(dot);
+    if (format == FrameFormat::Ppm) {
+      writePpm(name, frame);
+    } else {
+      writePng(name, frame);
+    }
+  }
+  ++m_frames;
+}
+
+}  // namespace bd
@@ -0,0 +1,89 @@
+#pragma once
+#ifndef RASTER_HPP
+#define RASTER_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "flock.hpp"
+
+namespace bd {
+
+// Draws boids without a window: the same triangles as main-sfml.cpp, filled
+// straight into an RGB framebuffer in memory. The frame is split in square
+// tiles; the triangles are binned to the tiles they touch and the tiles are
+// filled by parallel threads, each triangle in the order of the boids, so the
+// picture does not depend on the number of threads.
+class Rasterizer {
+  int m_width{};
+  int m_height{};
+  int threads{};
+  int tile{};
+  int tiles_x{};
+  int tiles_y{};
+  std::vector<std::uint8_t> m_pixels;  // r, g, b row by row from the top
+
+  // reused from frame to frame
+  std::vector<double> rotations;
+  std::vector<double> vx;
+  std::vector<double> vy;
+  std::vector<double> vertices;  // x0, y0, x1, y1, x2, y2 per boid
+  std::vector<int> tile_start;
+  std::vector<int> tile_items;
+
+  void bin(int n);
+  void fillTile(int t, const std::uint8_t rgb[3]);
+
+ public:
+  // threads: 0 for one per core
+  Rasterizer(int width, int height, int threads = 0, int tile = 64);
+
+  int width() const { return m_width; }
+  int height() const { return m_height; }
+  const std::vector<std::uint8_t>& pixels() const { return m_pixels; }
+
+  void clear(const Color& background = {});
+  // the world is stretched over the whole frame; side is the triangleSide of
+  // the viewer, in world units. Later flocks are drawn over earlier ones.
+  void draw(const Flock& flock, double side = 4);
+  // the same from the positions and velocities alone (e.g. of a Snapshot)
+  void draw(const std::vector<sf::Vector2<double>>& positions,
+            const std::vector<sf::Vector2<double>>& velocities,
+            const Color& color, double side = 4);
+};
+
+enum class FrameFormat { Ppm, Png, Raw };
+
+// from the extension of path: .ppm, .png, anything else is raw
+FrameFormat frameFormat(const std::string& path);
+
+void writePpm(const std::string& path, const Rasterizer& frame);
+// uncompressed (stored deflate blocks), so writing is as cheap as for PPM
+void writePng(const std::string& path, const Rasterizer& frame);
+
+// Ppm, Png: one file per frame, the frame number inserted before the
+// extension (frame.png -> frame00000.png, frame00001.png, ...).
+// Raw: every frame appended as rgb24 to path, which may be a named pipe
+// (e.g. read by ffmpeg -f rawvideo -pix_fmt rgb24 -s WxH -i PIPE), or "-"
+// for the standard output.
+class FrameWriter {
+  std::string path;
+  FrameFormat format;
+  int m_frames{};
+  std::FILE* stream{};
+
+ public:
+  FrameWriter(std::string path, FrameFormat format);
+  ~FrameWriter();
+  FrameWriter(const FrameWriter&) = delete;
+  FrameWriter& operator=(const FrameWriter&) = delete;
+
+  void write(const Rasterizer& frame);
+  int frames() const { return m_frames; }
+};
+
+}  // namespace bd
+
+#endif
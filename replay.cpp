@@ -0,0 +1,159 @@
+#include "replay.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "byteorder.hpp"
+#include "grid.hpp"
+
+namespace bd {
+
+namespace {
+constexpr char magic[8] = {'B', 'O', 'I', 'D', 'T', 'R', 'A', 'J'};
+constexpr std::uint32_t version = 1;
+
+void record(ReplayReport& report, const Divergence& div) {
+  if (report.first_failure < 0 && (div.position > report.tolerance ||
+                                   div.velocity > report.tolerance)) {
+    report.first_failure = report.steps.size();
+  }
+  report.steps.push_back(div);
+}
+}  // namespace
+
+Engine referenceEngine() {
+  return [](Flock& flock, double delta_t) {
+    const Flock::Mutation mutation = flock.mutate();
+    auto& boids = mutation.boids();
+    for (auto& boid : boids) {
+      boid.update(boids, delta_t);
+    }
+  };
+}
+
+Divergence divergence(const Flock& a, const Flock& b) {
+  if (a.size() != b.size()) {
+    throw std::runtime_error{
+        "Something went wrong. The flocks have a different number of "
+        "boids.\n"};
+  }
+  Divergence div;
+  for (int i = 0, N = a.size(); i < N; ++i) {
+    const Boid& p = a.flock()[i];
+    const Boid& q = b.flock()[i];
+    sf::Vector2<double> r = minimumImage(p.getPosition(), q.getPosition());
+    sf::Vector2<double> v = p.getVelocity() - q.getVelocity();
+    div.position = std::max(div.position, std::hypot(r.x, r.y));
+    div.velocity = std::max(div.velocity, std::hypot(v.x, v.y));
+  }
+  return div;
+}
+
+Divergence ReplayReport::max() const {
+  Divergence m;
+  for (const auto& s : steps) {
+    m.position = std::max(m.position, s.position);
+    m.velocity = std::max(m.velocity, s.velocity);
+  }
+  return m;
+}
+
+ReplayReport compareEngines(const Flock& initial, const Engine& reference,
+                            const Engine& candidate, int steps,
+                            double delta_t, double tolerance) {
+  Flock a = initial;
+  Flock b = initial;
+  ReplayReport report;
+  report.tolerance = tolerance;
+  for (int step = 0; step < steps; ++step) {
+    reference(a, delta_t);
+    candidate(b, delta_t);
+    record(report, divergence(a, b));
+  }
+  return report;
+}
+
+void recordTrajectory(const std::string& path, const Flock& initial,
+                      const Engine& engine, int steps, double delta_t) {
+  std::ofstream out(path, std::ios::binary);
+  if (!out) {
+    throw std::runtime_error{"Could not open " + path + "."};
+  }
+  const std::uint32_t n = initial.size();
+  const std::uint32_t k = steps;
+  out.write(magic, sizeof(magic));
+  putLittle(out, &version, 1);
+  putLittle(out, &n, 1);
+  putLittle(out, &k, 1);
+  putLittle(out, &delta_t, 1);
+
+  std::vector<double> buffer;
+  for (const auto& boid : initial.flock()) {
+    boid.pack(buffer);
+  }
+  putLittle(out, buffer.data(), buffer.size());
+
+  Flock flock = initial;
+  for (int step = 0; step < steps; ++step) {
+    engine(flock, delta_t);
+    buffer.clear();
+    for (const auto& boid : flock.flock()) {
+      buffer.insert(buffer.end(),
+                    {boid.getPosition().x, boid.getPosition().y,
+                     boid.getVelocity().x, boid.getVelocity().y});
+    }
+    putLittle(out, buffer.data(), buffer.size());
+  }
+  if (!out) {
+    throw std::runtime_error{"Could not write " + path + "."};
+  }
+}
+
+ReplayReport compareTrajectory(const std::string& path, const Engine& engine,
+                               double tolerance) {
+  std::ifstream in(path, std::ios::binary);
+  char head[8];
+  std::uint32_t v{}, n{}, k{};
+  double delta_t{};
+  if (!in.read(head, sizeof(head)) || std::memcmp(head, magic, 8) != 0 ||
+      !readLittle(in, &v, 1) || v != version || !readLittle(in, &n, 1) ||
+      !readLittle(in, &k, 1) || !readLittle(in, &delta_t, 1)) {
+    throw std::runtime_error{path + " is not a trajectory file."};
+  }
+
+  std::vector<double> buffer(n * Boid::packedSize);
+  if (!readLittle(in, buffer.data(), buffer.size())) {
+    throw std::runtime_error{path + " is truncated."};
+  }
+  Flock flock;
+  for (std::uint32_t i = 0; i < n; ++i) {
+    flock.addBoid(Boid::unpack(buffer.data() + i * Boid::packedSize));
+  }
+
+  // the golden boids are compared through a second flock of the same size
+  Flock golden = flock;
+  ReplayReport report;
+  report.tolerance = tolerance;
+  buffer.resize(n * 4);
+  for (std::uint32_t step = 0; step < k; ++step) {
+    if (!readLittle(in, buffer.data(), buffer.size())) {
+      throw std::runtime_error{path + " is truncated."};
+    }
+    {
+      const Flock::Mutation boids = golden.mutate();
+      for (std::uint32_t i = 0; i < n; ++i) {
+        boids[i] = Boid(buffer[4 * i], buffer[4 * i + 1]);
+        boids[i].setVelocity({buffer[4 * i + 2], buffer[4 * i + 3]});
+      }
+    }
+    engine(flock, delta_t);
+    record(report, divergence(golden, flock));
+  }
+  return report;
+}
+
+}  // namespace bd
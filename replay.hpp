@@ -0,0 +1,55 @@
+#pragma once
+#ifndef REPLAY_HPP
+#define REPLAY_HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "flock.hpp"
+
+namespace bd {
+
+// advances a flock by one step of delta_t
+using Engine = std::function<void(Flock&, double)>;
+
+// the brute force Boid::update over the whole flock, in order
+Engine referenceEngine();
+
+// largest distance (on the torus) and velocity difference between the
+// boids of two flocks, boid by boid
+struct Divergence {
+  double position{};
+  double velocity{};
+};
+
+Divergence divergence(const Flock& a, const Flock& b);
+
+struct ReplayReport {
+  std::vector<Divergence> steps;  // after every step
+  double tolerance{};
+  int first_failure{-1};  // first step past the tolerance, -1 if none
+
+  bool passed() const { return first_failure < 0; }
+  Divergence max() const;
+};
+
+// runs both engines from the same initial state for steps steps of delta_t
+ReplayReport compareEngines(const Flock& initial, const Engine& reference,
+                            const Engine& candidate, int steps,
+                            double delta_t, double tolerance);
+
+// Golden trajectories, little endian on any machine (byteorder.hpp):
+//   "BOIDTRAJ" | uint32 version | uint32 boids | uint32 steps | double delta_t
+//   | the initial boids, Boid::packedSize doubles each | for every step:
+//   x, y, vx, vy of every boid
+void recordTrajectory(const std::string& path, const Flock& initial,
+                      const Engine& engine, int steps, double delta_t);
+
+// replays the initial state of a golden file with engine and compares
+ReplayReport compareTrajectory(const std::string& path, const Engine& engine,
+                               double tolerance);
+
+}  // namespace bd
+
+#endif
@@ -0,0 +1,280 @@
+#pragma once
+#ifndef RULES_HPP
+#define RULES_HPP
+
+#include <algorithm>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "boid.hpp"
+#include "flock.hpp"
+#include "grid.hpp"
+
+namespace bd {
+
+// which distance a rule compares with its radius: the periodic distance()
+// or the plain e_distance() (used by cohesion). Topological rules use every
+// boid they are given (e.g. the k nearest), None rules no boid at all.
+enum class Metric { None, Periodic, Euclidean, Topological };
+
+// the boid being updated
+struct Self {
+  sf::Vector2<double> position;
+  sf::Vector2<double> velocity;
+  Parameters par;
+};
+
+// another boid as seen from Self; only the distances some rule needs are
+// computed
+struct Pair {
+  sf::Vector2<double> position;
+  sf::Vector2<double> velocity;
+  double distance{};
+  double e_distance{};
+};
+
+// A rule is a class with
+//   Metric metric                            distance it uses
+//   double radius(const Parameters&)         neighbours it looks at
+//   Acc                                      its accumulator
+//   void accumulate(Acc&, Self, Pair)        called for every boid
+//   sf::Vector2<double> finish(Acc, Self)    its velocity change
+// The three rules below reproduce Boid::separation, alignment and cohesion.
+
+struct Separation {
+  static constexpr Metric metric = Metric::Periodic;
+  struct Acc {
+    sf::Vector2<double> displacements;
+  };
+  double radius(const Parameters& par) const { return par.ds; }
+  void accumulate(Acc& acc, const Self& self, const Pair& other) const {
+    if (other.distance < self.par.ds) {
+      acc.displacements += other.position - self.position;
+    }
+  }
+  sf::Vector2<double> finish(const Acc& acc, const Self& self) const {
+    return -self.par.s * acc.displacements;
+  }
+};
+
+struct Alignment {
+  static constexpr Metric metric = Metric::Periodic;
+  struct Acc {
+    sf::Vector2<double> velocities;
+    int n{};
+  };
+  double radius(const Parameters& par) const { return par.d; }
+  void accumulate(Acc& acc, const Self& self, const Pair& other) const {
+    if (other.distance < self.par.d) {
+      acc.velocities += other.velocity - self.velocity;
+      acc.n++;
+    }
+  }
+  sf::Vector2<double> finish(const Acc& acc, const Self& self) const {
+    sf::Vector2<double> v2(0, 0);
+    if (acc.n > 1) {
+      v2 = self.par.a * (1.0 / (acc.n - 1)) * acc.velocities;
+    }
+    return v2;
+  }
+};
+
+struct Cohesion {
+  static constexpr Metric metric = Metric::Euclidean;
+  struct Acc {
+    sf::Vector2<double> sum_pos;
+    int n{};
+  };
+  double radius(const Parameters& par) const { return par.d; }
+  void accumulate(Acc& acc, const Self& self, const Pair& other) const {
+    if (other.e_distance < self.par.d) {
+      acc.sum_pos += other.position;
+      acc.n++;
+    }
+  }
+  sf::Vector2<double> finish(const Acc& acc, const Self& self) const {
+    sf::Vector2<double> v3(0, 0);
+    sf::Vector2<double> sum_pos = acc.sum_pos - self.position;
+    if (acc.n > 1) {
+      sf::Vector2<double> xc = (1.0 / (acc.n - 1)) * sum_pos;
+      v3 = self.par.c * (xc - self.position);
+    }
+    return v3;
+  }
+};
+
+// alignment and cohesion with every boid of the list, whatever its
+// distance: used with the k nearest neighbours. Positions are taken on the
+// torus, so neighbours across the border pull the right way.
+struct TopologicalAlignment {
+  static constexpr Metric metric = Metric::Topological;
+  struct Acc {
+    sf::Vector2<double> velocities;
+    int n{};
+  };
+  double radius(const Parameters&) const { return 0.; }
+  void accumulate(Acc& acc, const Self& self, const Pair& other) const {
+    acc.velocities += other.velocity - self.velocity;
+    acc.n++;
+  }
+  sf::Vector2<double> finish(const Acc& acc, const Self& self) const {
+    sf::Vector2<double> v2(0, 0);
+    if (acc.n > 1) {
+      v2 = self.par.a * (1.0 / (acc.n - 1)) * acc.velocities;
+    }
+    return v2;
+  }
+};
+
+struct TopologicalCohesion {
+  static constexpr Metric metric = Metric::Topological;
+  struct Acc {
+    sf::Vector2<double> offsets;
+    int n{};
+  };
+  double radius(const Parameters&) const { return 0.; }
+  void accumulate(Acc& acc, const Self& self, const Pair& other) const {
+    acc.offsets += minimumImage(self.position, other.position);
+    acc.n++;
+  }
+  sf::Vector2<double> finish(const Acc& acc, const Self& self) const {
+    sf::Vector2<double> v3(0, 0);
+    if (acc.n > 1) {
+      v3 = self.par.c * (1.0 / (acc.n - 1)) * acc.offsets;
+    }
+    return v3;
+  }
+};
+
+// constant drift, no neighbours
+struct Wind {
+  static constexpr Metric metric = Metric::None;
+  struct Acc {};
+  sf::Vector2<double> force;
+
+  double radius(const Parameters&) const { return 0.; }
+  void accumulate(Acc&, const Self&, const Pair&) const {}
+  sf::Vector2<double> finish(const Acc&, const Self&) const { return force; }
+};
+
+// steers towards a point of the world, along the shortest periodic path
+struct GoalSeeking {
+  static constexpr Metric metric = Metric::None;
+  struct Acc {};
+  sf::Vector2<double> goal;
+  double weight{};
+
+  double radius(const Parameters&) const { return 0.; }
+  void accumulate(Acc&, const Self&, const Pair&) const {}
+  sf::Vector2<double> finish(const Acc&, const Self& self) const {
+    return weight * minimumImage(self.position, goal);
+  }
+};
+
+// Fuses the chosen rules into a single loop over the boids: the distances
+// are computed once per pair, and only if some rule uses them, then every
+// rule accumulates its own sums. Rules not in the list are not compiled in.
+template <class... Rules>
+class RulePipeline {
+  std::tuple<Rules...> rules;
+
+  static constexpr bool periodic = ((Rules::metric == Metric::Periodic) || ...);
+  static constexpr bool euclidean =
+      ((Rules::metric == Metric::Euclidean) || ...);
+  static constexpr bool neighbours = ((Rules::metric != Metric::None) || ...);
+
+ public:
+  RulePipeline() = default;
+  explicit RulePipeline(Rules... r) : rules(r...) {}
+
+  // largest radius of the rules: boids farther than this are never used
+  double radius(const Parameters& par) const {
+    return std::apply(
+        [&par](const auto&... r) { return std::max({0., r.radius(par)...}); },
+        rules);
+  }
+
+  sf::Vector2<double> velocityChange(const Boid& boid,
+                                     const std::vector<Boid>& boids) const {
+    return changeOver(boid, boids.size(),
+                      [&boids](int j) -> const Boid& { return boids[j]; });
+  }
+
+  // over the boids at the given indices of boids, in that order: the
+  // neighbour searches pass their results without copying the boids
+  sf::Vector2<double> velocityChange(const Boid& boid,
+                                     const std::vector<Boid>& boids,
+                                     const std::vector<int>& indices) const {
+    return changeOver(boid, indices.size(), [&](int j) -> const Boid& {
+      return boids[indices[j]];
+    });
+  }
+
+  // same sequence as Boid::update
+  void update(Boid& boid, const std::vector<Boid>& boids,
+              double const delta_t) const {
+    boid.steer(velocityChange(boid, boids));
+    boid.updatePosition(delta_t);
+    boid.borders();
+  }
+
+ private:
+  template <class Get>
+  sf::Vector2<double> changeOver(const Boid& boid, int n, Get get) const {
+    const Self self{boid.getPosition(), boid.getVelocity(), boid.getPar()};
+    std::tuple<typename Rules::Acc...> accs;
+
+    if constexpr (neighbours) {
+      for (int j = 0; j < n; ++j) {
+        const Boid& other = get(j);
+        Pair pair{other.getPosition(), other.getVelocity(), 0., 0.};
+        if constexpr (periodic) {
+          pair.distance = bd::distance(self.position, pair.position);
+        }
+        if constexpr (euclidean) {
+          pair.e_distance = bd::e_distance(self.position, pair.position);
+        }
+        accumulateAll(accs, self, pair, std::index_sequence_for<Rules...>{});
+      }
+    }
+    return finishAll(accs, self, std::index_sequence_for<Rules...>{});
+  }
+
+  template <class Accs, std::size_t... I>
+  void accumulateAll(Accs& accs, const Self& self, const Pair& pair,
+                     std::index_sequence<I...>) const {
+    (std::get<I>(rules).accumulate(std::get<I>(accs), self, pair), ...);
+  }
+
+  template <class Accs, std::size_t... I>
+  sf::Vector2<double> finishAll(const Accs& accs, const Self& self,
+                                std::index_sequence<I...>) const {
+    sf::Vector2<double> dv(0, 0);
+    ((dv += std::get<I>(rules).finish(std::get<I>(accs), self)), ...);
+    return dv;
+  }
+};
+
+// the hard-coded rules of Boid::updateVelocity
+using Reynolds = RulePipeline<Separation, Alignment, Cohesion>;
+// separation within ds, alignment and cohesion with every boid of the list
+// (the k nearest); Flock::setTopological runs separation on the boids within
+// ds instead, which may be more than k
+using TopologicalReynolds =
+    RulePipeline<Separation, TopologicalAlignment, TopologicalCohesion>;
+
+// Flock::updateFlock with a custom pipeline
+template <class Pipeline>
+void updateFlock(Flock& flock, const Pipeline& pipeline,
+                 double const delta_t) {
+  const Flock::Mutation mutation = flock.mutate();
+  auto& boids = mutation.boids();
+  for (auto& boid : boids) {
+    pipeline.update(boid, boids, delta_t);
+  }
+}
+
+}  // namespace bd
+
+#endif
@@ -0,0 +1,349 @@
+// End-to-end scaling benchmark: runs whole scenarios with every engine,
+// boid count and thread count and writes one CSV row per combination.
+//
+//   boid.scale [--sizes 1000,10000,...] [--threads 1,2,4,...] [--steps K]
+//              [--budget SECONDS] [--seed S] [--out report.csv]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "boid.hpp"
+#include "bulk.hpp"
+#include "classed.hpp"
+#include "compact.hpp"
+#include "fixed.hpp"
+#include "flock.hpp"
+#include "scheduler.hpp"
+
+namespace {
+
+// the parameters of every scenario, also compiled into the fixed engine
+struct ScaleParameters {
+  static constexpr double d{20};
+  static constexpr double ds{5};
+  static constexpr double s{0.1};
+  static constexpr double a{0.1};
+  static constexpr double c{0.01};
+  static constexpr double maxspeed{100};
+};
+
+const bd::Parameters par{bd::FixedFlock<ScaleParameters>::parameters()};
+const double maxspeed{ScaleParameters::maxspeed};
+const double delta_t{0.05};
+
+enum class Scenario { Uniform, Cluster, Flocks, Churn };
+
+const char* name(Scenario s) {
+  switch (s) {
+    case Scenario::Uniform:
+      return "uniform";
+    case Scenario::Cluster:
+      return "cluster";
+    case Scenario::Flocks:
+      return "flocks";
+    case Scenario::Churn:
+      return "churn";
+  }
+  return "";
+}
+
+bd::Boid makeBoid(const sf::Vector2<double>& p, const sf::Vector2<double>& v) {
+  bd::Boid b(p.x, p.y);
+  b.setVelocity(v);
+  b.setPar(par);
+  b.setMaxspeed(maxspeed);
+  return b;
+}
+
+bd::Boid randomBoid(std::default_random_engine& eng) {
+  std::uniform_real_distribution<double> x(0, bd::worldWidth);
+  std::uniform_real_distribution<double> y(0, bd::worldHeight);
+  std::uniform_real_distribution<double> v(-maxspeed / 2, maxspeed / 2);
+  return makeBoid({x(eng), y(eng)}, {v(eng), v(eng)});
+}
+
+// uniform and churn: a gas over the whole world
+// cluster: every boid in one disc covering a tenth of the world
+// flocks:  groups of 100 boids around random centres, each group heading
+//          the same way
+bd::Flock makeFlock(Scenario s, int N, unsigned seed) {
+  if (s == Scenario::Uniform || s == Scenario::Churn) {
+    // built in parallel, the parameters checked once
+    return bd::uniformFlock(N, par, maxspeed, maxspeed / 2, seed);
+  }
+  std::default_random_engine eng(seed);
+  std::uniform_real_distribution<double> unit(0, 1);
+  std::normal_distribution<double> gauss(0, 1);
+  bd::Flock flock;
+  flock.reserve(N);
+  if (s == Scenario::Cluster) {
+    const double R = std::sqrt(bd::worldWidth * bd::worldHeight / (10 * M_PI));
+    for (int i = 0; i < N; ++i) {
+      const double r = R * std::sqrt(unit(eng));
+      const double phi = 2 * M_PI * unit(eng);
+      flock.addBoid(makeBoid({bd::worldWidth / 2 + r * std::cos(phi),
+                              bd::worldHeight / 2 + r * std::sin(phi)},
+                             {gauss(eng) * 10, gauss(eng) * 10}));
+    }
+  } else {
+    sf::Vector2<double> centre, heading;
+    for (int i = 0; i < N; ++i) {
+      if (i % 100 == 0) {
+        centre = {unit(eng) * bd::worldWidth, unit(eng) * bd::worldHeight};
+        const double phi = 2 * M_PI * unit(eng);
+        heading = {maxspeed / 2 * std::cos(phi), maxspeed / 2 * std::sin(phi)};
+      }
+      sf::Vector2<double> p{centre.x + 15 * gauss(eng),
+                            centre.y + 15 * gauss(eng)};
+      if (p.x < 0. || p.x > bd::worldWidth) p.x = centre.x;
+      if (p.y < 0. || p.y > bd::worldHeight) p.y = centre.y;
+      flock.addBoid(makeBoid(p, heading));
+    }
+  }
+  return flock;
+}
+
+// a simulation being measured: steps, and replaces boids for the churn
+struct Subject {
+  std::function<void(double)> step;
+  std::function<void(int, const bd::Boid&)> respawn;
+};
+
+struct Engine {
+  std::string name;
+  bool threaded{};
+  std::function<Subject(const bd::Flock&, int threads)> make;
+};
+
+std::vector<Engine> engines() {
+  std::vector<Engine> list;
+  list.push_back({"sequential", false, [](const bd::Flock& initial, int) {
+                    auto flock = std::make_shared<bd::Flock>(initial);
+                    return Subject{
+                        [flock](double dt) { flock->updateFlock(dt); },
+                        [flock](int i, const bd::Boid& b) {
+                          flock->setBoid(i, b);
+                        }};
+                  }});
+  list.push_back({"parallel", true, [](const bd::Flock& initial, int threads) {
+                    auto flock = std::make_shared<bd::Flock>(initial);
+                    flock->setScheduler(
+                        std::make_shared<bd::AdaptiveScheduler>(threads));
+                    return Subject{
+                        [flock](double dt) { flock->updateFlock(dt); },
+                        [flock](int i, const bd::Boid& b) {
+                          flock->setBoid(i, b);
+                        }};
+                  }});
+  list.push_back({"classed", false, [](const bd::Flock& initial, int) {
+                    auto flock = std::make_shared<bd::ClassedFlock>(
+                        bd::ClassedFlock::fromFlock(initial));
+                    return Subject{
+                        [flock](double dt) { flock->updateFlock(dt); },
+                        nullptr};
+                  }});
+  list.push_back({"fixed", false, [](const bd::Flock& initial, int) {
+                    auto flock = std::make_shared<
+                        bd::FixedFlock<ScaleParameters>>(
+                        bd::FixedFlock<ScaleParameters>::fromFlock(initial));
+                    return Subject{
+                        [flock](double dt) { flock->updateFlock(dt); },
+                        nullptr};
+                  }});
+  list.push_back({"compact", true, [](const bd::Flock& initial, int threads) {
+                    auto flock = std::make_shared<bd::CompactFlock>(initial);
+                    flock->setScheduler(
+                        std::make_shared<bd::AdaptiveScheduler>(threads));
+                    return Subject{
+                        [flock](double dt) { flock->updateFlock(dt); },
+                        nullptr};
+                  }});
+  return list;
+}
+
+// peak resident set size in kB since the last reset, from /proc
+void resetPeakRss() {
+  std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+long peakRss() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      return std::stol(line.substr(6));
+    }
+  }
+  return -1;
+}
+
+struct Row {
+  Scenario scenario;
+  std::string engine;
+  int boids{};
+  int threads{};
+  int steps{};
+  double seconds{};
+  long rss{};
+
+  double perStep() const { return seconds / steps; }
+};
+
+std::vector<int> parseList(const std::string& text) {
+  std::vector<int> list;
+  std::stringstream ss(text);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    list.push_back(std::stoi(item));
+    if (list.back() < 1) {
+      throw std::runtime_error{"Sizes and thread counts must be positive.\n"};
+    }
+  }
+  return list;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  try {
+    std::vector<int> sizes{1000, 10000, 100000, 1000000};
+    std::vector<int> threads;
+    int steps{10};
+    double budget{10.};  // seconds per measurement before giving up
+    unsigned seed{1};
+    std::string out{"scale.csv"};
+
+    const int cores = std::max(1u, std::thread::hardware_concurrency());
+    for (int t = 1; t <= std::min(cores, 64); t *= 2) threads.push_back(t);
+
+    for (int i = 1; i < argc; ++i) {
+      const std::string arg = argv[i];
+      if (i + 1 == argc) {
+        throw std::runtime_error{"Missing value after " + arg + ".\n"};
+      }
+      const std::string value = argv[++i];
+      if (arg == "--sizes") {
+        sizes = parseList(value);
+      } else if (arg == "--threads") {
+        threads = parseList(value);
+      } else if (arg == "--steps") {
+        steps = std::stoi(value);
+      } else if (arg == "--budget") {
+        budget = std::stod(value);
+      } else if (arg == "--seed") {
+        seed = std::stoul(value);
+      } else if (arg == "--out") {
+        out = value;
+      } else {
+        throw std::runtime_error{"Unknown option " + arg + ".\n"};
+      }
+    }
+    if (steps < 1) {
+      throw std::runtime_error{"At least one step is needed.\n"};
+    }
+    if (sizes.empty() || threads.empty()) {
+      throw std::runtime_error{"No sizes or thread counts to run.\n"};
+    }
+
+    std::vector<Row> rows;
+    for (Scenario s : {Scenario::Uniform, Scenario::Cluster, Scenario::Flocks,
+                       Scenario::Churn}) {
+      for (const Engine& engine : engines()) {
+        for (int T : threads) {
+          if (!engine.threaded && T > 1) continue;
+          // N T boids on T threads as well, for the weak scaling
+          std::vector<int> ns = sizes;
+          const int largest = *std::max_element(sizes.begin(), sizes.end());
+          for (int N : sizes) {
+            if (T > 1 && static_cast<long>(N) * T <= largest) {
+              ns.push_back(N * T);
+            }
+          }
+          std::sort(ns.begin(), ns.end());
+          ns.erase(std::unique(ns.begin(), ns.end()), ns.end());
+          for (int N : ns) {
+            const bd::Flock initial = makeFlock(s, N, seed);
+            resetPeakRss();
+            Subject subject = engine.make(initial, T);
+            if (s == Scenario::Churn && !subject.respawn) break;
+
+            // 1% of the boids die and are born elsewhere at every step
+            std::default_random_engine eng(seed + 1);
+            std::uniform_int_distribution<int> pick(0, N - 1);
+            Row row{s, engine.name, N, T};
+            const auto start = std::chrono::steady_clock::now();
+            while (row.steps < steps && row.seconds < budget) {
+              if (s == Scenario::Churn) {
+                for (int k = 0; k < N / 100; ++k) {
+                  subject.respawn(pick(eng), randomBoid(eng));
+                }
+              }
+              subject.step(delta_t);
+              ++row.steps;
+              row.seconds = std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+            }
+            row.rss = peakRss();
+            rows.push_back(row);
+            std::cout << name(s) << " " << engine.name << " N=" << N
+                      << " threads=" << T << ": " << row.steps / row.seconds
+                      << " steps/s\n";
+            // larger flocks would only take longer
+            if (row.steps < steps) break;
+          }
+        }
+      }
+    }
+
+    // strong scaling: same flock, T threads against one;
+    // weak scaling: N / T boids per thread against N / T boids on one thread
+    std::map<std::tuple<Scenario, std::string, int, int>, double> per_step;
+    for (const Row& r : rows) {
+      per_step[{r.scenario, r.engine, r.boids, r.threads}] = r.perStep();
+    }
+    auto lookup = [&per_step](const Row& r, int boids) {
+      auto it = per_step.find({r.scenario, r.engine, boids, 1});
+      return it == per_step.end() ? NAN : it->second;
+    };
+
+    std::ofstream report(out);
+    if (!report) {
+      throw std::runtime_error{"Could not open " + out + ".\n"};
+    }
+    report << "scenario,engine,boids,threads,steps,seconds,steps_per_second,"
+              "ns_per_boid_step,peak_rss_kb,strong_efficiency,"
+              "weak_efficiency,seed\n";
+    for (const Row& r : rows) {
+      const double strong = lookup(r, r.boids) / (r.threads * r.perStep());
+      const double weak = r.boids % r.threads == 0
+                              ? lookup(r, r.boids / r.threads) / r.perStep()
+                              : NAN;
+      report << name(r.scenario) << ',' << r.engine << ',' << r.boids << ','
+             << r.threads << ',' << r.steps << ',' << r.seconds << ','
+             << r.steps / r.seconds << ','
+             << r.perStep() / r.boids * 1e9 << ',' << r.rss << ',' << strong
+             << ',' << weak << ',' << seed << '\n';
+    }
+    std::cout << "Report written to " << out << "\n";
+  } catch (std::exception const& e) {
+    std::cerr << "Caught exception: '" << e.what() << "'\n";
+    return EXIT_FAILURE;
+  } catch (...) {
+    std::cerr << "Caught unknown exception\n";
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,183 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <numeric>
+#include <thread>
+
+namespace bd {
+
+bool StealingDeques::next(int worker, int& item) {
+  {
+    Deque& own = deques[worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.items.empty()) {
+      item = own.items.back();
+      own.items.pop_back();
+      return true;
+    }
+  }
+  const int W = deques.size();
+  for (int k = 1; k < W; ++k) {
+    Deque& victim = deques[(worker + k) % W];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.items.empty()) {
+      item = victim.items.front();
+      victim.items.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+AdaptiveScheduler::AdaptiveScheduler(int max_threads_)
+    : max_threads{max_threads_} {
+  if (max_threads <= 0) {
+    max_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  m_threads = max_threads;
+  base = max_threads;
+  for (int w = 1; w < max_threads; ++w) {
+    pool.emplace_back(&AdaptiveScheduler::serve, this, w);
+  }
+}
+
+AdaptiveScheduler::~AdaptiveScheduler() {
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto& t : pool) t.join();
+}
+
+// a pool thread: runs its part of every round it takes part in
+void AdaptiveScheduler::serve(int worker) {
+  std::uint64_t seen = 0;
+  std::unique_lock<std::mutex> lock(pool_mutex);
+  while (true) {
+    wake.wait(lock, [&] { return stopping || round != seen; });
+    if (stopping) return;
+    seen = round;
+    if (worker >= job_workers) continue;
+    lock.unlock();
+    job(worker);
+    lock.lock();
+    if (--pending == 0) done.notify_one();
+  }
+}
+
+void AdaptiveScheduler::run(const std::vector<double>& weights,
+                            const std::function<void(int, int)>& work) {
+  using clock = std::chrono::steady_clock;
+  const int T = weights.size();
+  if (T == 0) return;
+  const double total = std::accumulate(weights.begin(), weights.end(), 0.);
+
+  // consecutive tasks up to the target weight make a chunk
+  const int W = m_threads;
+  const double target = total / (W * chunks_per_worker);
+  std::vector<int> chunk_start{0};
+  double weight = 0.;
+  for (int t = 0; t < T; ++t) {
+    weight += weights[t];
+    if (weight >= target && t + 1 < T) {
+      chunk_start.push_back(t + 1);
+      weight = 0.;
+    }
+  }
+  chunk_start.push_back(T);
+  const int C = chunk_start.size() - 1;
+
+  const auto start = clock::now();
+  const int workers_n = std::min(W, C);
+  std::vector<double> finished(workers_n);
+  if (workers_n == 1) {
+    work(0, T);
+  } else {
+    // contiguous runs of chunks per worker, for locality
+    StealingDeques deques(workers_n);
+    for (int c = C - 1; c >= 0; --c) {
+      deques.push(static_cast<long>(c) * workers_n / C, c);
+    }
+    std::vector<std::exception_ptr> errors(workers_n);
+    auto body = [&](int w) {
+      try {
+        int c;
+        while (deques.next(w, c)) {
+          work(chunk_start[c], chunk_start[c + 1]);
+        }
+      } catch (...) {
+        errors[w] = std::current_exception();
+      }
+      finished[w] =
+          std::chrono::duration<double>(clock::now() - start).count();
+    };
+    {
+      std::lock_guard<std::mutex> lock(pool_mutex);
+      job = body;
+      job_workers = workers_n;
+      pending = workers_n - 1;
+      ++round;
+    }
+    wake.notify_all();
+    body(0);
+    {
+      std::unique_lock<std::mutex> lock(pool_mutex);
+      done.wait(lock, [this] { return pending == 0; });
+      job = nullptr;
+    }
+    for (auto& e : errors) {
+      if (e) std::rethrow_exception(e);
+    }
+  }
+  last_time = std::chrono::duration<double>(clock::now() - start).count();
+
+  last_imbalance = 0.;
+  const double latest = *std::max_element(finished.begin(), finished.end());
+  if (workers_n > 1 && latest > 0.) {
+    const double mean =
+        std::accumulate(finished.begin(), finished.end(), 0.) / workers_n;
+    last_imbalance = 1. - mean / latest;
+  }
+  adapt(last_time / std::max(total, 1e-300), last_imbalance, workers_n);
+}
+
+void AdaptiveScheduler::adapt(double cost, double imbalance, int workers) {
+  if (probing) {
+    probing = false;
+    // a probe must be clearly faster to win, timing noise is not enough
+    if (cost < 0.97 * base_cost) {
+      base = m_threads;
+      base_cost = cost;
+    } else {
+      direction = -direction;
+      m_threads = base;
+    }
+  } else {
+    base_cost = base_cost > 0. ? 0.7 * base_cost + 0.3 * cost : cost;
+    if (++since_probe >= probeEvery) {
+      since_probe = 0;
+      int probe = base + direction;
+      if (probe < 1 || probe > max_threads) {
+        direction = -direction;
+        probe = base + direction;
+      }
+      if (probe >= 1 && probe <= max_threads) {
+        m_threads = probe;
+        probing = true;
+      }
+    }
+  }
+
+  if (workers > 1) {
+    if (imbalance > 0.15 && chunks_per_worker < maxChunksPerWorker) {
+      chunks_per_worker *= 2;
+    } else if (imbalance < 0.05 && chunks_per_worker > 1) {
+      chunks_per_worker /= 2;
+    }
+  }
+}
+
+}  // namespace bd
@@ -0,0 +1,99 @@
+#pragma once
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace bd {
+
+// one deque of items per worker: the owner takes from the back, the thieves
+// from the front, so that they rarely contend for the same item
+class StealingDeques {
+  struct Deque {
+    std::mutex mutex;
+    std::deque<int> items;
+  };
+  std::vector<Deque> deques;
+
+ public:
+  explicit StealingDeques(int workers) : deques(workers) {}
+
+  // only before the workers start
+  void push(int worker, int item) { deques[worker].items.push_back(item); }
+  // false when every deque is empty
+  bool next(int worker, int& item);
+};
+
+// Runs a list of weighted tasks in parallel and tunes itself from the time
+// every run takes. The tasks are cut into chunks of about the same weight,
+// chunksPerWorker() per worker, dealt in order to the workers and stolen
+// when a worker runs dry.
+//   threads: starts at max_threads; every probeEvery runs one more or one
+//            less thread is tried, and kept if the time per unit of weight
+//            drops, so the count follows the load as it changes.
+//   chunks:  more (smaller) chunks when the workers finished unevenly,
+//            fewer when they were balanced, to cut the synchronisation.
+// The workers are threads started once by the constructor and woken for
+// every run, the caller of run being worker 0.
+// Not thread safe: one run at a time.
+class AdaptiveScheduler {
+  int max_threads{};
+  int m_threads{};
+  int chunks_per_worker{4};
+
+  int base{};       // thread count being measured
+  int direction{-1};  // next probe: base + direction
+  bool probing{};
+  int since_probe{};
+  double base_cost{};  // smoothed seconds per unit of weight with base
+
+  double last_time{};
+  double last_imbalance{};
+
+  // workers 1 .. max_threads - 1, waiting for the next round
+  std::vector<std::thread> pool;
+  std::mutex pool_mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  std::function<void(int)> job;
+  int job_workers{};
+  int pending{};
+  std::uint64_t round{};
+  bool stopping{};
+
+  void adapt(double cost, double imbalance, int workers);
+  void serve(int worker);
+
+ public:
+  static constexpr int probeEvery{8};
+  static constexpr int maxChunksPerWorker{64};
+
+  // max_threads: 0 for one per core
+  explicit AdaptiveScheduler(int max_threads = 0);
+  ~AdaptiveScheduler();
+  AdaptiveScheduler(const AdaptiveScheduler&) = delete;
+  AdaptiveScheduler& operator=(const AdaptiveScheduler&) = delete;
+
+  // work(begin, end) must process the tasks [begin, end); it is called from
+  // several threads at once on disjoint ranges
+  void run(const std::vector<double>& weights,
+           const std::function<void(int, int)>& work);
+
+  int threads() const { return m_threads; }
+  int maxThreads() const { return max_threads; }
+  int chunksPerWorker() const { return chunks_per_worker; }
+  // wall time of the last run and 1 - mean / max of the times its workers
+  // finished at (0: perfectly balanced)
+  double lastTime() const { return last_time; }
+  double imbalance() const { return last_imbalance; }
+};
+
+}  // namespace bd
+
+#endif
@@ -0,0 +1,85 @@
+#include "shm.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace bd {
+
+std::size_t shmSlotBytes(std::uint64_t capacity) {
+  return sizeof(SlotHeader) + 4 * capacity * sizeof(double);
+}
+
+std::size_t shmBytes(std::uint64_t capacity, std::uint32_t slots) {
+  return sizeof(ShmHeader) + slots * shmSlotBytes(capacity);
+}
+
+SnapshotReader::SnapshotReader(const std::string& name) {
+  const int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    throw std::runtime_error{"Nothing is published as " + name + "."};
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0 ||
+      static_cast<std::size_t>(st.st_size) < sizeof(ShmHeader)) {
+    ::close(fd);
+    throw std::runtime_error{name + " is not a published flock."};
+  }
+  bytes = st.st_size;
+  void* p = ::mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    throw std::runtime_error{"Could not map " + name + "."};
+  }
+  base = static_cast<const unsigned char*>(p);
+
+  const ShmHeader& h = header();
+  if (std::memcmp(h.magic, "BOIDSHM1", 8) != 0 || h.version != shmVersion ||
+      bytes < shmBytes(h.capacity, h.slots) || h.slots == 0) {
+    ::munmap(const_cast<unsigned char*>(base), bytes);
+    throw std::runtime_error{name + " is not a published flock."};
+  }
+}
+
+SnapshotReader::~SnapshotReader() {
+  ::munmap(const_cast<unsigned char*>(base), bytes);
+}
+
+std::uint64_t SnapshotReader::published() const {
+  return header().published.load(std::memory_order_acquire);
+}
+
+bool SnapshotReader::latest(Frame& out, int attempts) const {
+  const ShmHeader& h = header();
+  for (int attempt = 0; attempt < attempts; ++attempt) {
+    const std::uint64_t n = h.published.load(std::memory_order_acquire);
+    if (n == 0) return false;
+    const unsigned char* slot = base + sizeof(ShmHeader) +
+                                ((n - 1) % h.slots) * shmSlotBytes(h.capacity);
+    const SlotHeader& s = *reinterpret_cast<const SlotHeader*>(slot);
+
+    const std::uint64_t before = s.sequence.load(std::memory_order_acquire);
+    if (before % 2 == 1) continue;  // being written
+    out.frame = s.frame;
+    out.generation = s.generation;
+    const std::size_t count = std::min(s.count, h.capacity);
+    const double* arrays =
+        reinterpret_cast<const double*>(slot + sizeof(SlotHeader));
+    std::vector<double>* fields[4] = {&out.x, &out.y, &out.vx, &out.vy};
+    for (int k = 0; k < 4; ++k) {
+      fields[k]->assign(arrays + k * h.capacity,
+                        arrays + k * h.capacity + count);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // the copy is good only if no write started in the meantime
+    if (s.sequence.load(std::memory_order_relaxed) == before) return true;
+  }
+  return false;
+}
+
+}  // namespace bd
@@ -0,0 +1,87 @@
+#pragma once
+#ifndef SHM_HPP
+#define SHM_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace bd {
+
+// Layout of the POSIX shared memory object a SnapshotPublisher (see
+// publisher.hpp) writes the flock into at every step:
+//   ShmHeader, then `slots` slots of shmSlotBytes(capacity) bytes, each a
+//   SlotHeader followed by the x, y, vx and vy arrays of capacity doubles.
+// Frame f goes to slot f % slots. Every slot is a seqlock: its sequence is
+// odd while it is written, so a reader copies it and checks that the
+// sequence did not change meanwhile. The writer never waits for readers.
+// This header and shm.cpp do not depend on the rest of the simulation, so
+// that external tools can link them alone.
+
+struct ShmHeader {
+  char magic[8];  // "BOIDSHM1"
+  std::uint32_t version;
+  std::uint32_t slots;
+  std::uint64_t capacity;  // boids per slot
+  // frames published so far: the newest is published - 1
+  std::atomic<std::uint64_t> published;
+};
+
+struct SlotHeader {
+  std::atomic<std::uint64_t> sequence;
+  std::uint64_t frame;
+  std::uint64_t generation;  // Flock::generation() of the frame
+  std::uint64_t count;       // boids in the frame
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+              "shared memory needs lock-free 64-bit atomics");
+
+constexpr std::uint32_t shmVersion{1};
+
+std::size_t shmSlotBytes(std::uint64_t capacity);
+std::size_t shmBytes(std::uint64_t capacity, std::uint32_t slots);
+
+// a consistent copy of one published step, in structure of arrays form
+struct Frame {
+  std::uint64_t frame{};
+  std::uint64_t generation{};
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<double> vx;
+  std::vector<double> vy;
+
+  int size() const { return x.size(); }
+};
+
+// Read-only view of a published flock. Any number of readers can attach,
+// in any process, without the writer noticing.
+class SnapshotReader {
+  const unsigned char* base{};
+  std::size_t bytes{};
+
+  const ShmHeader& header() const {
+    return *reinterpret_cast<const ShmHeader*>(base);
+  }
+
+ public:
+  // name as given to the publisher, e.g. "/boids"
+  explicit SnapshotReader(const std::string& name);
+  SnapshotReader(const SnapshotReader&) = delete;
+  SnapshotReader& operator=(const SnapshotReader&) = delete;
+  ~SnapshotReader();
+
+  std::uint64_t published() const;
+  std::uint64_t capacity() const { return header().capacity; }
+  std::uint32_t slots() const { return header().slots; }
+
+  // copies the newest frame into out; false when nothing was published yet
+  // or when the writer overwrote the frame during every attempt
+  bool latest(Frame& out, int attempts = 16) const;
+};
+
+}  // namespace bd
+
+#endif
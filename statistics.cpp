@@ -0,0 +1,207 @@
+#include "statistics.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "byteorder.hpp"
+
+namespace bd {
+
+namespace {
+const char magic[8] = {'B', 'O', 'I', 'D', 'S', 'T', 'A', 'T'};
+const std::uint32_t version = 1;
+}  // namespace
+
+StatisticsSink::StatisticsSink(const std::string& path,
+                               std::vector<std::string> columns,
+                               SinkFormat f, int chunk)
+    : m_path(path),
+      m_columns(std::move(columns)),
+      format(f),
+      chunk_rows(chunk) {
+  if (m_columns.empty()) {
+    throw std::runtime_error{"A statistics file needs at least one column."};
+  }
+  if (chunk_rows < 1) {
+    throw std::runtime_error{"Chunks must hold at least one row."};
+  }
+  file = std::fopen(path.c_str(), format == SinkFormat::Binary ? "wb" : "w");
+  if (file == nullptr) {
+    throw std::runtime_error{"Could not open " + path + "."};
+  }
+  if (!writeHeader()) {
+    std::fclose(file);
+    file = nullptr;
+    throw std::runtime_error{"Could not write " + path + "."};
+  }
+  current.resize(m_columns.size() * chunk_rows);
+  writer = std::thread(&StatisticsSink::run, this);
+}
+
+// a destructor cannot throw: a failure still goes to the standard error
+StatisticsSink::~StatisticsSink() {
+  try {
+    close();
+  } catch (std::exception const& e) {
+    std::cerr << e.what() << '\n';
+  }
+}
+
+bool StatisticsSink::writeHeader() {
+  bool ok = true;
+  if (format == SinkFormat::Csv) {
+    for (int c = 0, C = m_columns.size(); c < C; ++c) {
+      ok = ok && std::fprintf(file, c == 0 ? "%s" : ",%s",
+                              m_columns[c].c_str()) >= 0;
+    }
+    return ok && std::fputc('\n', file) != EOF;
+  }
+  const std::uint32_t n = m_columns.size();
+  ok = std::fwrite(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+       putLittle(file, &version, 1) && putLittle(file, &n, 1);
+  for (const std::string& name : m_columns) {
+    const std::uint32_t length = name.size();
+    ok = ok && putLittle(file, &length, 1) &&
+         std::fwrite(name.data(), 1, length, file) == length;
+  }
+  return ok;
+}
+
+bool StatisticsSink::writeChunk(const std::vector<double>& chunk, int n) {
+  const int C = m_columns.size();
+  bool ok = true;
+  if (format == SinkFormat::Csv) {
+    for (int r = 0; r < n; ++r) {
+      for (int c = 0; c < C; ++c) {
+        ok = ok && std::fprintf(file, c == 0 ? "%.17g" : ",%.17g",
+                                chunk[c * chunk_rows + r]) >= 0;
+      }
+      ok = ok && std::fputc('\n', file) != EOF;
+    }
+    return ok;
+  }
+  const std::uint32_t rows32 = n;
+  ok = putLittle(file, &rows32, 1);
+  for (int c = 0; c < C; ++c) {
+    ok = ok && putLittle(file, chunk.data() + c * chunk_rows, n);
+  }
+  return ok;
+}
+
+void StatisticsSink::run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    wake.wait(lock, [this] { return closing || !full.empty(); });
+    if (full.empty()) return;  // closing with nothing left to write
+
+    auto chunk = std::move(full.front());
+    full.pop_front();
+    // the disk is touched without holding the lock
+    lock.unlock();
+    const bool ok = writeChunk(chunk.first, chunk.second);
+    lock.lock();
+    failed = failed || !ok;
+    spare.push_back(std::move(chunk.first));
+  }
+}
+
+void StatisticsSink::flushCurrent() {
+  if (rows == 0) return;
+  std::lock_guard<std::mutex> lock(mutex);
+  full.emplace_back(std::move(current), rows);
+  if (!spare.empty()) {
+    current = std::move(spare.back());
+    spare.pop_back();
+  } else {
+    current.assign(m_columns.size() * chunk_rows, 0.);
+  }
+  rows = 0;
+  wake.notify_one();
+}
+
+void StatisticsSink::record(const std::vector<double>& values) {
+  if (file == nullptr) {
+    throw std::runtime_error{"The statistics file is already closed."};
+  }
+  if (values.size() != m_columns.size()) {
+    throw std::runtime_error{"Wrong number of values for the statistics row."};
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (failed) {
+      throw std::runtime_error{"Could not write " + m_path + "."};
+    }
+  }
+  for (int c = 0, C = values.size(); c < C; ++c) {
+    current[c * chunk_rows + rows] = values[c];
+  }
+  if (++rows == chunk_rows) {
+    flushCurrent();
+  }
+}
+
+void StatisticsSink::close() {
+  if (file == nullptr) return;
+  flushCurrent();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    closing = true;
+  }
+  wake.notify_one();
+  writer.join();
+  // fclose writes what is still buffered: a full disk shows up here too
+  const bool closed = std::fclose(file) == 0;
+  file = nullptr;
+  if (failed || !closed) {
+    throw std::runtime_error{"Could not write " + m_path + "."};
+  }
+}
+
+const std::vector<double>& StatisticsTable::column(
+    const std::string& name) const {
+  for (int c = 0, C = names.size(); c < C; ++c) {
+    if (names[c] == name) return columns[c];
+  }
+  throw std::runtime_error{"No column named " + name + "."};
+}
+
+StatisticsTable readStatistics(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  char head[8];
+  std::uint32_t v{};
+  std::uint32_t n{};
+  if (!in.read(head, sizeof(head)) || std::memcmp(head, magic, 8) != 0 ||
+      !readLittle(in, &v, 1) || v != version || !readLittle(in, &n, 1)) {
+    throw std::runtime_error{path + " is not a statistics file."};
+  }
+
+  StatisticsTable table;
+  table.names.resize(n);
+  table.columns.resize(n);
+  for (std::string& name : table.names) {
+    std::uint32_t length{};
+    if (!readLittle(in, &length, 1)) {
+      throw std::runtime_error{path + " is truncated."};
+    }
+    name.resize(length);
+    in.read(name.data(), length);
+  }
+
+  std::uint32_t rows{};
+  while (readLittle(in, &rows, 1)) {
+    for (auto& column : table.columns) {
+      std::size_t start = column.size();
+      column.resize(start + rows);
+      if (!readLittle(in, column.data() + start, rows)) {
+        throw std::runtime_error{path + " is truncated."};
+      }
+    }
+  }
+  return table;
+}
+
+}  // namespace bd
@@ -0,0 +1,79 @@
+#pragma once
+#ifndef STATISTICS_HPP
+#define STATISTICS_HPP
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bd {
+
+enum class SinkFormat { Binary, Csv };
+
+// streams one row of metrics per step to a file. Rows are collected in
+// chunks of chunk_rows and written by a background thread, so that record()
+// only copies a few doubles. A failed write (a full disk) makes the next
+// record() and close() throw.
+//
+// Binary layout (little endian on every machine, column-major row groups):
+//   "BOIDSTAT" | uint32 version | uint32 columns | for every column:
+//   uint32 length, name | then chunks: uint32 rows, rows doubles of column 0,
+//   rows doubles of column 1, ...
+class StatisticsSink {
+  std::string m_path;
+  std::vector<std::string> m_columns;
+  SinkFormat format;
+  int chunk_rows{};
+  std::FILE* file{};
+
+  std::vector<double> current;  // column-major chunk being filled
+  int rows{};
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<std::pair<std::vector<double>, int>> full;
+  std::vector<std::vector<double>> spare;
+  bool closing{};
+  bool failed{};
+  std::thread writer;
+
+  // false if the file did not take everything
+  bool writeHeader();
+  bool writeChunk(const std::vector<double>& chunk, int n);
+  void run();
+  void flushCurrent();
+
+ public:
+  StatisticsSink(const std::string& path, std::vector<std::string> columns,
+                 SinkFormat format = SinkFormat::Binary,
+                 int chunk_rows = 4096);
+  ~StatisticsSink();
+  StatisticsSink(const StatisticsSink&) = delete;
+  StatisticsSink& operator=(const StatisticsSink&) = delete;
+
+  const std::vector<std::string>& columns() const { return m_columns; }
+
+  // values are in the order of the columns
+  void record(const std::vector<double>& values);
+  // writes everything and closes the file, throws if something could not
+  // be written; called by the destructor, which reports on std::cerr
+  void close();
+};
+
+// content of a binary statistics file
+struct StatisticsTable {
+  std::vector<std::string> names;
+  std::vector<std::vector<double>> columns;
+
+  const std::vector<double>& column(const std::string& name) const;
+};
+
+StatisticsTable readStatistics(const std::string& path);
+
+}  // namespace bd
+
+#endif
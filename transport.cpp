@@ -0,0 +1,231 @@
+#include "transport.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace bd {
+
+std::vector<Message> Transport::allgather(const Message& mine) {
+  std::vector<Message> outgoing(size(), mine);
+  std::vector<Message> all = exchange(outgoing);
+  all[rank()] = mine;
+  return all;
+}
+
+Message Transport::allreduce(const Message& mine) {
+  Message sum(mine.size(), 0.);
+  for (const Message& m : allgather(mine)) {
+    if (m.size() != sum.size()) {
+      throw std::runtime_error{"Ranks reduced vectors of different length."};
+    }
+    for (int i = 0, N = sum.size(); i < N; ++i) {
+      sum[i] += m[i];
+    }
+  }
+  return sum;
+}
+
+LocalTransport::LocalTransport(std::shared_ptr<Mailboxes> b, int r)
+    : boxes(std::move(b)), m_rank(r) {}
+
+std::vector<LocalTransport> LocalTransport::create(int n) {
+  if (n < 1) {
+    throw std::runtime_error{"A transport needs at least one rank."};
+  }
+  auto boxes = std::make_shared<Mailboxes>();
+  boxes->n = n;
+  boxes->queues.resize(n * n);
+
+  std::vector<LocalTransport> endpoints;
+  for (int r = 0; r < n; ++r) {
+    endpoints.push_back(LocalTransport(boxes, r));
+  }
+  return endpoints;
+}
+
+std::vector<Message> LocalTransport::exchange(
+    const std::vector<Message>& outgoing) {
+  const int n = size();
+  std::vector<Message> incoming(n);
+
+  std::unique_lock<std::mutex> lock(boxes->mutex);
+  for (int r = 0; r < n; ++r) {
+    if (r != m_rank) {
+      boxes->queues[m_rank * n + r].push_back(outgoing[r]);
+    }
+  }
+  boxes->ready.notify_all();
+
+  for (int r = 0; r < n; ++r) {
+    if (r == m_rank) continue;
+    auto& queue = boxes->queues[r * n + m_rank];
+    boxes->ready.wait(lock, [&queue] { return !queue.empty(); });
+    incoming[r] = std::move(queue.front());
+    queue.pop_front();
+  }
+  return incoming;
+}
+
+SocketTransport::SocketTransport(std::vector<int> f, int r)
+    : fds(std::move(f)), m_rank(r) {}
+
+SocketTransport::SocketTransport(SocketTransport&& other) noexcept
+    : fds(std::move(other.fds)), m_rank(other.m_rank) {
+  other.fds.clear();
+}
+
+SocketTransport& SocketTransport::operator=(SocketTransport&& other) noexcept {
+  if (this != &other) {
+    for (int fd : fds) {
+      if (fd >= 0) close(fd);
+    }
+    fds = std::move(other.fds);
+    m_rank = other.m_rank;
+    other.fds.clear();
+  }
+  return *this;
+}
+
+SocketTransport::~SocketTransport() {
+  for (int fd : fds) {
+    if (fd >= 0) close(fd);
+  }
+}
+
+std::vector<SocketTransport> SocketTransport::create(int n) {
+  if (n < 1) {
+    throw std::runtime_error{"A transport needs at least one rank."};
+  }
+  std::vector<std::vector<int>> table(n, std::vector<int>(n, -1));
+
+  for (int i = 0; i < n; ++i) {
+    for (int j = i + 1; j < n; ++j) {
+      int pair[2];
+      if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+        throw std::runtime_error{"Could not create the tile sockets: " +
+                                 std::string{std::strerror(errno)}};
+      }
+      for (int fd : pair) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      }
+      table[i][j] = pair[0];
+      table[j][i] = pair[1];
+    }
+  }
+
+  std::vector<SocketTransport> endpoints;
+  for (int r = 0; r < n; ++r) {
+    endpoints.push_back(SocketTransport(table[r], r));
+  }
+  return endpoints;
+}
+
+// every message is framed as a 64 bit count of doubles followed by the data;
+// reads never go past the current frame, so a fast peer that already started
+// the next exchange cannot confuse us.
+std::vector<Message> SocketTransport::exchange(
+    const std::vector<Message>& outgoing) {
+  const int n = size();
+
+  struct Peer {
+    std::vector<char> out;
+    std::size_t sent{};
+    std::uint64_t count{};
+    std::size_t header_read{};
+    std::size_t body_read{};
+    bool done_in{};
+  };
+  std::vector<Peer> peers(n);
+  std::vector<Message> incoming(n);
+
+  int pending = 0;
+  for (int r = 0; r < n; ++r) {
+    if (r == m_rank) continue;
+    std::uint64_t count = outgoing[r].size();
+    Peer& p = peers[r];
+    p.out.resize(sizeof(count) + count * sizeof(double));
+    std::memcpy(p.out.data(), &count, sizeof(count));
+    if (count > 0) {
+      std::memcpy(p.out.data() + sizeof(count), outgoing[r].data(),
+                  count * sizeof(double));
+    }
+    pending += 2;  // one write and one read for every peer
+  }
+
+  std::vector<pollfd> polls;
+  std::vector<int> owners;
+  while (pending > 0) {
+    polls.clear();
+    owners.clear();
+    for (int r = 0; r < n; ++r) {
+      if (r == m_rank) continue;
+      Peer& p = peers[r];
+      short events = 0;
+      if (p.sent < p.out.size()) events |= POLLOUT;
+      if (!p.done_in) events |= POLLIN;
+      if (events != 0) {
+        polls.push_back({fds[r], events, 0});
+        owners.push_back(r);
+      }
+    }
+
+    if (poll(polls.data(), polls.size(), -1) < 0) {
+      if (errno == EINTR) continue;
+      throw std::runtime_error{"Tile exchange failed: " +
+                               std::string{std::strerror(errno)}};
+    }
+
+    for (int k = 0, K = polls.size(); k < K; ++k) {
+      const int r = owners[k];
+      Peer& p = peers[r];
+      if ((polls[k].revents & POLLOUT) && p.sent < p.out.size()) {
+        ssize_t w = write(fds[r], p.out.data() + p.sent, p.out.size() - p.sent);
+        if (w > 0) {
+          p.sent += w;
+          if (p.sent == p.out.size()) --pending;
+        } else if (w < 0 && errno != EAGAIN && errno != EINTR) {
+          throw std::runtime_error{"Tile exchange failed while sending."};
+        }
+      }
+      if ((polls[k].revents & (POLLIN | POLLHUP)) && !p.done_in) {
+        ssize_t got = 0;
+        if (p.header_read < sizeof(p.count)) {
+          got = read(fds[r], reinterpret_cast<char*>(&p.count) + p.header_read,
+                     sizeof(p.count) - p.header_read);
+          if (got > 0) {
+            p.header_read += got;
+            if (p.header_read == sizeof(p.count)) {
+              incoming[r].resize(p.count);
+            }
+          }
+        } else {
+          got = read(fds[r],
+                     reinterpret_cast<char*>(incoming[r].data()) + p.body_read,
+                     p.count * sizeof(double) - p.body_read);
+          if (got > 0) p.body_read += got;
+        }
+        if (got == 0) {
+          throw std::runtime_error{"Tile exchange: peer closed its socket."};
+        }
+        if (got < 0 && errno != EAGAIN && errno != EINTR) {
+          throw std::runtime_error{"Tile exchange failed while receiving."};
+        }
+        if (p.header_read == sizeof(p.count) &&
+            p.body_read == p.count * sizeof(double)) {
+          p.done_in = true;
+          --pending;
+        }
+      }
+    }
+  }
+  return incoming;
+}
+
+}  // namespace bd
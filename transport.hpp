@@ -0,0 +1,87 @@
+#pragma once
+#ifndef TRANSPORT_HPP
+#define TRANSPORT_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace bd {
+
+// a message between tiles is just a flat array of doubles
+using Message = std::vector<double>;
+
+// pluggable communication layer between the processes (or threads) that own
+// the tiles of a decomposed world. Every rank must call exchange() the same
+// number of times: it is a collective all-to-all step.
+class Transport {
+ public:
+  virtual ~Transport() = default;
+
+  virtual int rank() const = 0;
+  virtual int size() const = 0;
+
+  // outgoing[r] is sent to rank r (outgoing[rank()] is ignored), the returned
+  // vector holds in position r what rank r sent to us.
+  virtual std::vector<Message> exchange(const std::vector<Message>& outgoing) = 0;
+
+  // every rank receives the message of every other rank
+  std::vector<Message> allgather(const Message& mine);
+  // element-wise sum of the vectors of all the ranks
+  Message allreduce(const Message& mine);
+};
+
+// in-process transport: the ranks are threads sharing the same mailboxes
+class LocalTransport : public Transport {
+  struct Mailboxes {
+    std::mutex mutex;
+    std::condition_variable ready;
+    // one queue for every (from, to) couple
+    std::vector<std::deque<Message>> queues;
+    int n{};
+  };
+
+  std::shared_ptr<Mailboxes> boxes;
+  int m_rank{};
+
+  LocalTransport(std::shared_ptr<Mailboxes> b, int r);
+
+ public:
+  // builds the n connected endpoints, endpoint i has rank i
+  static std::vector<LocalTransport> create(int n);
+
+  int rank() const override { return m_rank; }
+  int size() const override { return boxes->n; }
+
+  std::vector<Message> exchange(const std::vector<Message>& outgoing) override;
+};
+
+// transport over Unix domain sockets: create() must be called before fork(),
+// then every process keeps the endpoint of its own rank. It works the same
+// way between threads of a single process.
+class SocketTransport : public Transport {
+  std::vector<int> fds;  // fds[r] is the socket connected to rank r
+  int m_rank{};
+
+  SocketTransport(std::vector<int> f, int r);
+
+ public:
+  static std::vector<SocketTransport> create(int n);
+
+  SocketTransport(SocketTransport&& other) noexcept;
+  SocketTransport& operator=(SocketTransport&& other) noexcept;
+  SocketTransport(const SocketTransport&) = delete;
+  SocketTransport& operator=(const SocketTransport&) = delete;
+  ~SocketTransport() override;
+
+  int rank() const override { return m_rank; }
+  int size() const override { return fds.size(); }
+
+  std::vector<Message> exchange(const std::vector<Message>& outgoing) override;
+};
+
+}  // namespace bd
+
+#endif
@@ -0,0 +1,70 @@
+// Example consumer of a published flock: attaches to the shared memory a
+// SnapshotPublisher writes and prints a summary of the newest frame.
+//
+//   boid.watch [--name /boids] [--every MILLISECONDS] [--count N]
+//
+// It links only shm.cpp: any tool can read the flock the same way.
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "shm.hpp"
+
+int main(int argc, char* argv[]) {
+  try {
+    std::string name{"/boids"};
+    int every{500};
+    int count{0};  // 0: forever
+
+    for (int i = 1; i < argc; ++i) {
+      const std::string arg = argv[i];
+      if (i + 1 == argc) {
+        throw std::runtime_error{"Missing value after " + arg + ".\n"};
+      }
+      const std::string value = argv[++i];
+      if (arg == "--name") {
+        name = value;
+      } else if (arg == "--every") {
+        every = std::stoi(value);
+      } else if (arg == "--count") {
+        count = std::stoi(value);
+      } else {
+        throw std::runtime_error{"Unknown option " + arg + ".\n"};
+      }
+    }
+
+    const bd::SnapshotReader reader(name);
+    std::cout << "Attached to " << name << ": " << reader.capacity()
+              << " boids, " << reader.slots() << " slots\n";
+
+    bd::Frame frame;
+    std::uint64_t last = 0;
+    for (int shown = 0; count == 0 || shown < count;) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(every));
+      if (!reader.latest(frame) || (shown > 0 && frame.frame == last)) {
+        continue;
+      }
+      double speed = 0.;
+      for (int i = 0; i < frame.size(); ++i) {
+        speed += std::hypot(frame.vx[i], frame.vy[i]);
+      }
+      if (frame.size() > 0) speed /= frame.size();
+      std::cout << "frame " << frame.frame << " (" << frame.frame - last
+                << " since the last shown): " << frame.size()
+                << " boids, mean speed " << speed << "\n";
+      last = frame.frame;
+      ++shown;
+    }
+  } catch (std::exception const& e) {
+    std::cerr << "Caught exception: '" << e.what() << "'\n";
+    return EXIT_FAILURE;
+  } catch (...) {
+    std::cerr << "Caught unknown exception\n";
+    return EXIT_FAILURE;
+  }
+}